@@ -0,0 +1,380 @@
+/**
+ * FogLAMP OutOfBound datapoint expressions
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "expression.h"
+
+using namespace std;
+
+/**
+ * Compile an expression
+ *
+ * @param    source	The expression
+ * @return		False on syntax error, see getError()
+ */
+bool Expression::compile(const string& source)
+{
+	m_source = source;
+	m_code.clear();
+	m_constants.clear();
+	m_operands.clear();
+	m_depth = 0;
+	m_pos = 0;
+	m_error.clear();
+
+	if (!parseSum())
+	{
+		return false;
+	}
+	skipSpaces();
+	if (m_pos != m_source.length())
+	{
+		return fail("unexpected character");
+	}
+	return m_error.empty();
+}
+
+/**
+ * Run the expression
+ *
+ * @param    operands	The operand values, in getOperands() order
+ * @return		The expression value
+ */
+double Expression::evaluate(const double *operands) const
+{
+	double stack[EXPRESSION_MAX_STACK];
+	int top = -1;
+
+	for (auto& i : m_code)
+	{
+		switch (i.op)
+		{
+		case OP_CONST:
+			stack[++top] = m_constants[i.arg];
+			break;
+		case OP_LOAD:
+			stack[++top] = operands[i.arg];
+			break;
+		case OP_ADD:
+			top--;
+			stack[top] += stack[top + 1];
+			break;
+		case OP_SUB:
+			top--;
+			stack[top] -= stack[top + 1];
+			break;
+		case OP_MUL:
+			top--;
+			stack[top] *= stack[top + 1];
+			break;
+		case OP_DIV:
+			top--;
+			stack[top] /= stack[top + 1];
+			break;
+		case OP_NEG:
+			stack[top] = -stack[top];
+			break;
+		case OP_ABS:
+			stack[top] = fabs(stack[top]);
+			break;
+		case OP_SQRT:
+			stack[top] = sqrt(stack[top]);
+			break;
+		case OP_MIN:
+			top--;
+			stack[top] = fmin(stack[top], stack[top + 1]);
+			break;
+		case OP_MAX:
+			top--;
+			stack[top] = fmax(stack[top], stack[top + 1]);
+			break;
+		}
+	}
+
+	return stack[0];
+}
+
+/**
+ * sum := product (('+' | '-') product)*
+ */
+bool Expression::parseSum()
+{
+	if (!parseProduct())
+	{
+		return false;
+	}
+	for (;;)
+	{
+		skipSpaces();
+		if (m_pos >= m_source.length() ||
+		    (m_source[m_pos] != '+' && m_source[m_pos] != '-'))
+		{
+			return true;
+		}
+		OpCode op = m_source[m_pos++] == '+' ? OP_ADD : OP_SUB;
+		if (!parseProduct())
+		{
+			return false;
+		}
+		emit(op);
+	}
+}
+
+/**
+ * product := unary (('*' | '/') unary)*
+ */
+bool Expression::parseProduct()
+{
+	if (!parseUnary())
+	{
+		return false;
+	}
+	for (;;)
+	{
+		skipSpaces();
+		if (m_pos >= m_source.length() ||
+		    (m_source[m_pos] != '*' && m_source[m_pos] != '/'))
+		{
+			return true;
+		}
+		OpCode op = m_source[m_pos++] == '*' ? OP_MUL : OP_DIV;
+		if (!parseUnary())
+		{
+			return false;
+		}
+		emit(op);
+	}
+}
+
+/**
+ * unary := '-' unary | primary
+ */
+bool Expression::parseUnary()
+{
+	skipSpaces();
+	if (m_pos < m_source.length() && m_source[m_pos] == '-')
+	{
+		m_pos++;
+		if (!parseUnary())
+		{
+			return false;
+		}
+		emit(OP_NEG);
+		return true;
+	}
+	return parsePrimary();
+}
+
+/**
+ * primary := number | name | '{' name '}' | function '(' sum [',' sum] ')'
+ *	    | '(' sum ')'
+ */
+bool Expression::parsePrimary()
+{
+	skipSpaces();
+	if (m_pos >= m_source.length())
+	{
+		return fail("unexpected end");
+	}
+
+	char c = m_source[m_pos];
+	if (c == '(')
+	{
+		m_pos++;
+		if (!parseSum())
+		{
+			return false;
+		}
+		skipSpaces();
+		if (m_pos >= m_source.length() || m_source[m_pos] != ')')
+		{
+			return fail("missing ')'");
+		}
+		m_pos++;
+		return true;
+	}
+
+	if (isdigit((unsigned char)c) || c == '.')
+	{
+		const char *start = m_source.c_str() + m_pos;
+		char *end;
+		double value = strtod(start, &end);
+		if (end == start)
+		{
+			return fail("invalid number");
+		}
+		m_pos += end - start;
+		m_constants.push_back(value);
+		emit(OP_CONST, m_constants.size() - 1);
+		return true;
+	}
+
+	if (c == '{')
+	{
+		size_t end = m_source.find('}', m_pos);
+		if (end == string::npos || end == m_pos + 1)
+		{
+			return fail("invalid datapoint name");
+		}
+		emit(OP_LOAD, operand(m_source.substr(m_pos + 1, end - m_pos - 1)));
+		m_pos = end + 1;
+		return true;
+	}
+
+	if (isalpha((unsigned char)c) || c == '_')
+	{
+		size_t start = m_pos;
+		while (m_pos < m_source.length() &&
+		       (isalnum((unsigned char)m_source[m_pos]) || m_source[m_pos] == '_'))
+		{
+			m_pos++;
+		}
+		string name = m_source.substr(start, m_pos - start);
+
+		skipSpaces();
+		if (m_pos >= m_source.length() || m_source[m_pos] != '(')
+		{
+			emit(OP_LOAD, operand(name));
+			return true;
+		}
+
+		// Function call
+		OpCode op;
+		int arguments = 1;
+		if (name.compare("abs") == 0)
+		{
+			op = OP_ABS;
+		}
+		else if (name.compare("sqrt") == 0)
+		{
+			op = OP_SQRT;
+		}
+		else if (name.compare("min") == 0)
+		{
+			op = OP_MIN;
+			arguments = 2;
+		}
+		else if (name.compare("max") == 0)
+		{
+			op = OP_MAX;
+			arguments = 2;
+		}
+		else
+		{
+			return fail("unknown function");
+		}
+		m_pos++;
+		for (int i = 0; i < arguments; i++)
+		{
+			if (i > 0)
+			{
+				skipSpaces();
+				if (m_pos >= m_source.length() || m_source[m_pos] != ',')
+				{
+					return fail("missing function argument");
+				}
+				m_pos++;
+			}
+			if (!parseSum())
+			{
+				return false;
+			}
+		}
+		skipSpaces();
+		if (m_pos >= m_source.length() || m_source[m_pos] != ')')
+		{
+			return fail("missing ')'");
+		}
+		m_pos++;
+		emit(op);
+		return true;
+	}
+
+	return fail("unexpected character");
+}
+
+/**
+ * Skip white spaces at the parse position
+ */
+void Expression::skipSpaces()
+{
+	while (m_pos < m_source.length() && isspace((unsigned char)m_source[m_pos]))
+	{
+		m_pos++;
+	}
+}
+
+/**
+ * Set the compilation error
+ *
+ * @param    message	The error message
+ * @return		False
+ */
+bool Expression::fail(const char *message)
+{
+	if (m_error.empty())
+	{
+		m_error = string(message) + " at position " + to_string(m_pos);
+	}
+	return false;
+}
+
+/**
+ * Add an instruction, tracking the stack depth
+ *
+ * @param    op		The instruction code
+ * @param    arg	The constant or operand index
+ */
+void Expression::emit(OpCode op, uint32_t arg)
+{
+	Instruction i;
+	i.op = op;
+	i.arg = arg;
+	m_code.push_back(i);
+
+	switch (op)
+	{
+	case OP_CONST:
+	case OP_LOAD:
+		if (++m_depth > EXPRESSION_MAX_STACK)
+		{
+			fail("expression too deep");
+		}
+		break;
+	case OP_NEG:
+	case OP_ABS:
+	case OP_SQRT:
+		break;
+	default:
+		m_depth--;
+		break;
+	}
+}
+
+/**
+ * Return the index of a datapoint operand, adding it if new
+ *
+ * @param    name	The datapoint name
+ * @return		The operand index
+ */
+uint32_t Expression::operand(const string& name)
+{
+	for (size_t i = 0; i < m_operands.size(); i++)
+	{
+		if (m_operands[i].getName().compare(name) == 0)
+		{
+			return i;
+		}
+	}
+	m_operands.push_back(DatapointPath(name));
+	return m_operands.size() - 1;
+}
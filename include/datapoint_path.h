@@ -0,0 +1,142 @@
+#ifndef _DATAPOINT_PATH_H
+#define _DATAPOINT_PATH_H
+/*
+ * FogLAMP OutOfBound datapoint lookup
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <ctype.h>
+#include <rapidjson/document.h>
+
+using namespace rapidjson;
+
+/**
+ * A step of a datapoint path: an object member,
+ * or an array element if the index is not negative
+ */
+struct PathStep
+{
+	std::string		member;
+	long			index;
+};
+
+/**
+ * Lookup of a datapoint in an asset reading
+ *
+ * The datapoint name is a member of the asset object or,
+ * if it starts with "/", a JSON pointer to a nested value
+ * such as "/motor/phases/0", split at configuration time.
+ */
+class DatapointPath
+{
+	public:
+		DatapointPath(const std::string& name) : m_name(name)
+		{
+			if (isPath(name))
+			{
+				compile();
+			}
+		};
+
+		const std::string&	getName() const { return m_name; };
+		bool			operator==(const DatapointPath& other) const
+					{
+						return m_name == other.m_name;
+					};
+		static bool		isPath(const std::string& name)
+					{
+						return !name.empty() && name[0] == '/';
+					};
+		/**
+		 * Return the datapoint value of an asset
+		 *
+		 * @param    asset	The asset object
+		 * @return		The value or NULL if not found
+		 */
+		const Value		*find(const Value& asset) const
+					{
+						if (m_steps.empty())
+						{
+							Value::ConstMemberIterator m =
+								asset.FindMember(m_name.c_str());
+							return m != asset.MemberEnd() ? &m->value : NULL;
+						}
+						const Value *v = &asset;
+						for (auto& step : m_steps)
+						{
+							if (v->IsObject())
+							{
+								Value::ConstMemberIterator m =
+									v->FindMember(step.member.c_str());
+								if (m == v->MemberEnd())
+								{
+									return NULL;
+								}
+								v = &m->value;
+							}
+							else if (v->IsArray() &&
+								 step.index >= 0 &&
+								 step.index < (long)v->Size())
+							{
+								v = &(*v)[(SizeType)step.index];
+							}
+							else
+							{
+								return NULL;
+							}
+						}
+						return v;
+					};
+
+	private:
+		/**
+		 * Split the JSON pointer into unescaped steps
+		 */
+		void			compile()
+					{
+						size_t start = 1;
+						while (start <= m_name.length())
+						{
+							size_t end = m_name.find('/', start);
+							if (end == std::string::npos)
+							{
+								end = m_name.length();
+							}
+							PathStep step;
+							for (size_t i = start; i < end; i++)
+							{
+								if (m_name[i] == '~' && i + 1 < end &&
+								    (m_name[i + 1] == '0' || m_name[i + 1] == '1'))
+								{
+									step.member += m_name[++i] == '0' ? '~' : '/';
+								}
+								else
+								{
+									step.member += m_name[i];
+								}
+							}
+							char *last;
+							step.index = strtol(step.member.c_str(), &last, 10);
+							if (step.member.empty() || *last ||
+							    !isdigit((unsigned char)step.member[0]))
+							{
+								step.index = -1;
+							}
+							m_steps.push_back(step);
+							start = end + 1;
+						}
+					};
+
+	private:
+		std::string		m_name;
+		std::vector<PathStep>	m_steps;
+};
+
+#endif
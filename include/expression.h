@@ -0,0 +1,85 @@
+#ifndef _EXPRESSION_H
+#define _EXPRESSION_H
+/*
+ * FogLAMP OutOfBound datapoint expressions
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "datapoint_path.h"
+
+#define EXPRESSION_MAX_STACK	32
+
+/**
+ * An arithmetic expression over datapoints of the same asset
+ *
+ * Operators: + - * / and unary -, parentheses,
+ * functions abs(a), sqrt(a), min(a, b) and max(a, b).
+ * Operands: numbers and datapoint names; names which are not
+ * identifiers, or JSON pointers, are written in braces:
+ * "{flow in} - {/pipe/flow_out}".
+ *
+ * The expression is compiled into a stack machine program,
+ * run with a fixed size stack: no allocation on evaluation.
+ */
+class Expression
+{
+	public:
+		Expression() : m_depth(0), m_pos(0) {};
+
+		bool			compile(const std::string& source);
+		const std::string&	getSource() const { return m_source; };
+		const std::string&	getError() const { return m_error; };
+		const std::vector<DatapointPath>&
+					getOperands() const { return m_operands; };
+		double			evaluate(const double *operands) const;
+
+	private:
+		enum OpCode
+		{
+			OP_CONST,
+			OP_LOAD,
+			OP_ADD,
+			OP_SUB,
+			OP_MUL,
+			OP_DIV,
+			OP_NEG,
+			OP_ABS,
+			OP_SQRT,
+			OP_MIN,
+			OP_MAX
+		};
+		struct Instruction
+		{
+			uint8_t		op;
+			uint32_t	arg;	// Constant or operand index
+		};
+
+		bool			parseSum();
+		bool			parseProduct();
+		bool			parseUnary();
+		bool			parsePrimary();
+		void			skipSpaces();
+		bool			fail(const char *message);
+		void			emit(OpCode op, uint32_t arg = 0);
+		uint32_t		operand(const std::string& name);
+
+	private:
+		std::string		m_source;
+		std::vector<Instruction>
+					m_code;
+		std::vector<double>	m_constants;
+		std::vector<DatapointPath>
+					m_operands;
+		int			m_depth;	// Stack depth while compiling
+		size_t			m_pos;		// Parse position
+		std::string		m_error;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef _NAME_MATCHER_H
+#define _NAME_MATCHER_H
+/*
+ * FogLAMP OutOfBound asset and datapoint name patterns
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <string>
+#include <vector>
+#include <bitset>
+#include <stddef.h>
+
+#define NAME_MATCHER_MAX_STATES	4096
+#define NAME_MATCHER_MAX_REPEAT	64
+// Prefix of the regular expression patterns
+#define NAME_MATCHER_REGEX	"re:"
+
+/**
+ * A set of glob or regular expression patterns matched in one pass
+ *
+ * Glob patterns: "*" any sequence, "?" any character,
+ * "[abc]", "[a-z]" and "[!a-z]" character classes.
+ *
+ * Regular expressions, with the "re:" prefix, match the whole name:
+ * ".", "[a-z]", "[^a-z]", "\d", "\w", "\s", alternatives "a|b",
+ * groups "( )" and the "*", "+", "?", "{m}", "{m,}" and "{m,n}"
+ * repetitions.
+ *
+ * The patterns are compiled into one NFA, then into a single DFA
+ * over byte classes, so a name is matched in time proportional to
+ * its length, whatever the number of patterns. If the DFA would
+ * exceed NAME_MATCHER_MAX_STATES the patterns are matched one by one.
+ */
+class NameMatcher
+{
+	public:
+		NameMatcher() : m_classes(0), m_compiled(false) {};
+
+		static bool	isPattern(const std::string& name)
+				{
+					return isRegex(name) ||
+						name.find_first_of("*?[") != std::string::npos;
+				};
+		static bool	isRegex(const std::string& name)
+				{
+					return name.compare(0,
+							    sizeof(NAME_MATCHER_REGEX) - 1,
+							    NAME_MATCHER_REGEX) == 0;
+				};
+		bool		add(const std::string& pattern, int id);
+		void		compile();
+		bool		empty() const { return m_patterns.empty(); };
+		const std::vector<int>&
+				match(const char *name,
+				      size_t length,
+				      std::vector<int>& matches) const;
+		bool		matches(const char *name, size_t length) const;
+
+	private:
+		/**
+		 * An NFA node: a transition on a character set
+		 * and up to two transitions on no character
+		 */
+		struct Node
+		{
+			std::bitset<256>	chars;
+			int			next;	// Target on chars, -1 if none
+			int			epsilon[2];
+		};
+		/**
+		 * A part of the NFA being built: its nodes are the ones
+		 * from first to the last added, end has no transitions
+		 */
+		struct Fragment
+		{
+			int			first;
+			int			start;
+			int			end;
+		};
+		struct Pattern
+		{
+			int			id;
+			int			start;	// Start node
+			int			accept;	// Accept node
+		};
+
+		int		addNode();
+		void		link(int from, int to);
+		Fragment	emptyFragment();
+		Fragment	chars(const std::bitset<256>& set);
+		void		concat(Fragment& fragment, const Fragment& next);
+		void		star(Fragment& fragment);
+		void		optional(Fragment& fragment);
+		Fragment	copy(const std::vector<Node>& nodes, const Fragment& fragment);
+		bool		parseGlob(const std::string& pattern, Fragment& fragment);
+		bool		parseAlternation(const std::string& re,
+						 size_t& pos,
+						 Fragment& fragment);
+		bool		parseSequence(const std::string& re,
+					      size_t& pos,
+					      Fragment& fragment);
+		bool		parseRepeat(const std::string& re,
+					    size_t& pos,
+					    Fragment& fragment);
+		bool		parseAtom(const std::string& re,
+					  size_t& pos,
+					  Fragment& fragment);
+		bool		parseEscape(const std::string& re,
+					    size_t& pos,
+					    std::bitset<256>& set);
+		bool		parseClass(const std::string& re,
+					   size_t& pos,
+					   std::bitset<256>& set);
+		void		closure(std::vector<int>& positions,
+					std::vector<char>& marks) const;
+		int		run(const unsigned char *name, size_t length) const;
+		bool		matchPattern(const Pattern& pattern,
+					     const unsigned char *name,
+					     size_t length) const;
+
+	private:
+		std::vector<Pattern>	m_patterns;
+		std::vector<Node>	m_nodes;	// NFA of all patterns
+		std::vector<int>	m_accept;	// Pattern index of accept nodes
+		unsigned char		m_classOf[256];
+		size_t			m_classes;
+		std::vector<int>	m_next;		// states x classes, -1 no match
+		std::vector<std::vector<int> >
+					m_matches;	// Pattern ids of each state
+		bool			m_compiled;
+};
+
+#endif
@@ -10,10 +10,51 @@
  * Author: Massimiliano Pinto
  */
 #include <plugin.h>
+#include <plugin_api.h>
 #include <plugin_manager.h>
 #include <config_category.h>
 #include <rule_plugin.h>
 #include <builtin_rule.h>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include "rule_program.h"
+#include "timestamp_formatter.h"
+
+/**
+ * JSON document using the parse scratch allocators
+ */
+typedef GenericDocument<UTF8<>, MemoryPoolAllocator<>, MemoryPoolAllocator<> > ScratchDocument;
+
+/**
+ * Parse scratch memory: preallocated buffers for the DOM values
+ * and the parser stack, cleared after each evaluation.
+ * One per thread in concurrent evaluation mode.
+ */
+class ParseScratch
+{
+	public:
+		ParseScratch() :
+			m_valueAllocator(m_valueBuffer, sizeof(m_valueBuffer)),
+			m_stackAllocator(m_stackBuffer, sizeof(m_stackBuffer)) {};
+
+		MemoryPoolAllocator<>	*getValueAllocator() { return &m_valueAllocator; };
+		MemoryPoolAllocator<>	*getStackAllocator() { return &m_stackAllocator; };
+		void			clear()
+					{
+						m_valueAllocator.Clear();
+						m_stackAllocator.Clear();
+					};
+
+	private:
+		char			m_valueBuffer[32768];
+		char			m_stackBuffer[4096];
+		MemoryPoolAllocator<>	m_valueAllocator;
+		MemoryPoolAllocator<>	m_stackAllocator;
+};
 
 /**
  * OutOfBound class, derived from Notification BuiltinRule
@@ -25,11 +66,96 @@ class OutOfBound: public BuiltinRule
 		~OutOfBound();
 
 		void	configure(const ConfigCategory& config);
+		bool	updateThresholds(const std::string& patch);
 		void	lockConfig() { m_configMutex.lock(); };
 		void	unlockConfig() { m_configMutex.unlock(); };
+		bool	evaluate(const std::string& assetValues,
+				 std::vector<bool> *results = NULL);
+		bool	evaluate(const Value& doc,
+				 std::vector<bool> *results = NULL);
+		std::string
+			getReason(const std::string& ruleSetId);
+		void	checkpoint();
+		void	restore();
+		bool	isConcurrent() const { return m_concurrent; };
+		ParseScratch&
+			getScratch();
+		std::shared_ptr<RuleProgram>
+			getProgram() const { return std::atomic_load(&m_program); };
+
+	private:
+		void	startCheckpoints();
+		void	stopCheckpoints();
+		void	checkpointer();
+		void	configureRules(const Value& rules,
+				       RuleSet& ruleSet,
+				       const RuleSet *previous);
+		void	configureOptions(const Value& options, RuleSet& ruleSet);
+		bool	evalHeld(const char *payload,
+				 size_t length,
+				 std::vector<bool> *results,
+				 bool& eval);
+		bool	isHeld(const RuleSet& ruleSet,
+			       double timestamp,
+			       bool& eval);
+		bool	updateRuleSet(const Value& doc, const RuleSet& ruleSet);
+		bool	ruleResult(const RuleProgram& program,
+				   const std::vector<char>& evals,
+				   std::vector<bool> *results);
+		bool	evalRuleSet(const Value& doc,
+				    const RuleSet& ruleSet,
+				    double& timestamp,
+				    EvalCause& cause,
+				    bool& memoised);
+		int	evalAssetPatterns(const Value& doc,
+					  const RuleSet& ruleSet,
+					  double& timestamp,
+					  EvalCause& cause);
+		bool	mergeState(const RuleSet& ruleSet,
+				   bool eval,
+				   double timestamp,
+				   const EvalCause& cause,
+				   bool memoised);
+		void	startRing(const std::string& name);
+		void	stopRing();
+		void	ringConsumer();
 
 	private:
-		std::mutex	m_configMutex;	
+		std::mutex		m_configMutex;	
+		std::shared_ptr<RuleProgram>
+					m_program;
+		std::mutex		m_programMutex;	// Serialises the program updates
+		std::mutex		m_evalMutex;	// Serialises non concurrent evaluations
+		std::shared_ptr<RuleSetState>
+					m_primaryState;
+		std::atomic<bool>	m_concurrent;
+		std::atomic<bool>	m_payloadCache;
+		ParseScratch		m_scratch;
+		StringBuffer		m_reasonBuffer;
+		Writer<StringBuffer>	m_reasonWriter;
+		TimestampFormatter	m_timestampFormatter;
+		std::string		m_name;
+		std::string		m_statePath;
+		std::mutex		m_checkpointMutex;
+		std::atomic<long>	m_checkpointInterval;
+		std::thread		*m_checkpointThread;
+		bool			m_checkpointRunning;
+		std::mutex		m_checkpointWaitMutex;
+		std::condition_variable	m_checkpointCond;
+		std::string		m_ringName;
+		std::thread		*m_ringThread;
+		std::atomic<bool>	m_ringRunning;
 };
 
+/**
+ * Rule set entry points for a host linking the plugin:
+ * not part of the notification rule plugin interface
+ */
+std::vector<bool>
+	plugin_eval_rule_sets(PLUGIN_HANDLE handle, const std::string& assetValues);
+std::string
+	plugin_rule_sets(PLUGIN_HANDLE handle);
+std::string
+	plugin_rule_set_reason(PLUGIN_HANDLE handle, const std::string& id);
+
 #endif
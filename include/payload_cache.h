@@ -0,0 +1,72 @@
+#ifndef _PAYLOAD_CACHE_H
+#define _PAYLOAD_CACHE_H
+/*
+ * FogLAMP OutOfBound process wide parsed payload cache
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <string>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <builtin_rule.h>
+
+#define PAYLOAD_CACHE_SLOTS	64
+
+/**
+ * A parsed notification data document, never changed
+ * once built, shared by all the rule instances
+ */
+class CachedPayload
+{
+	public:
+		CachedPayload(uint64_t key, const std::string& payload);
+
+		bool			matches(uint64_t key, const std::string& payload) const
+					{
+						return m_key == key &&
+							m_payload.compare(payload) == 0;
+					};
+		bool			isValid() const { return !m_document.HasParseError(); };
+		const Document&		getDocument() const { return m_document; };
+
+	private:
+		uint64_t		m_key;
+		std::string		m_payload;
+		Document		m_document;
+};
+
+/**
+ * Process wide cache of parsed notification data
+ *
+ * Rule instances receiving the same notification data
+ * parse the whole document once: the first one adds it to the
+ * cache, the others get it from the cache. A hit costs a hash
+ * and a comparison of the data, and a lock of its cache slot
+ * only held to copy the slot pointer. The parsed document does
+ * not depend on the rule configurations, so it is kept across
+ * reconfigurations.
+ */
+class PayloadCache
+{
+	public:
+		static PayloadCache&	getInstance();
+
+		std::shared_ptr<const CachedPayload>
+					get(const std::string& payload);
+
+	private:
+		PayloadCache() {};
+		static uint64_t		hash(const char *data, size_t length);
+
+	private:
+		std::mutex		m_locks[PAYLOAD_CACHE_SLOTS];
+		std::shared_ptr<const CachedPayload>
+					m_slots[PAYLOAD_CACHE_SLOTS];
+};
+
+#endif
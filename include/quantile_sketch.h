@@ -0,0 +1,135 @@
+#ifndef _QUANTILE_SKETCH_H
+#define _QUANTILE_SKETCH_H
+/*
+ * FogLAMP OutOfBound streaming quantile sketch
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <string>
+#include <stdint.h>
+
+#define QUANTILE_STORE_BINS		512
+#define QUANTILE_SKETCH_ACCURACY	0.01	// Relative value accuracy
+#define QUANTILE_SKETCH_MIN_VALUE	1e-9	// Smaller magnitudes count as 0
+#define QUANTILE_WINDOW_BUCKETS		6
+
+/**
+ * Counts of value magnitudes by logarithm
+ *
+ * The bins cover a fixed range of keys: when a magnitude is
+ * out of range the lowest bins are merged, so the accuracy
+ * is kept for the values far from 0.
+ */
+class QuantileStore
+{
+	public:
+		void		clear();
+		void		add(int key, uint32_t count = 1);
+		void		merge(const QuantileStore& other);
+		void		save(std::string& data) const;
+		const char	*load(const char *data, const char *end);
+		int		getMinKey() const { return m_minKey; };
+		int		getMaxKey() const { return m_maxKey; };
+		uint32_t	getCount(int key) const
+				{
+					return key < m_offset ||
+					       key >= m_offset + QUANTILE_STORE_BINS ?
+						0 : m_bins[key - m_offset];
+				};
+
+	private:
+		uint64_t	m_count;
+		int		m_offset;	// Key of the first bin
+		int		m_minKey;
+		int		m_maxKey;
+		uint32_t	m_bins[QUANTILE_STORE_BINS];
+};
+
+/**
+ * Log histogram of values with bounded relative error
+ *
+ * A value is counted in the bin of the logarithm of its magnitude,
+ * positive and negative values in separate stores, so quantiles
+ * are returned within QUANTILE_SKETCH_ACCURACY of the true value.
+ *
+ * Sketches of different values are merged by adding their counts.
+ * Only the used bins are saved in the state snapshot.
+ */
+class QuantileSketch
+{
+	public:
+		void		clear();
+		void		add(double value);
+		void		merge(const QuantileSketch& other);
+		void		save(std::string& data) const;
+		const char	*load(const char *data, const char *end);
+		uint64_t	getCount() const { return m_count; };
+		uint64_t	getZeroCount() const { return m_zero; };
+		const QuantileStore&
+				getStore(bool negative) const
+				{
+					return negative ? m_negative : m_positive;
+				};
+
+		static int	key(double magnitude);
+		static double	value(int key);
+
+	private:
+		uint64_t	m_count;
+		uint64_t	m_zero;
+		QuantileStore	m_positive;
+		QuantileStore	m_negative;
+};
+
+/**
+ * Quantiles of the values of a time window
+ *
+ * The window is split in QUANTILE_WINDOW_BUCKETS buckets with a sketch
+ * each: the sketch of the oldest bucket is cleared when the window
+ * slides, so memory is fixed whatever the number of values:
+ * about 25 KB per window, of which only the used bins are saved.
+ */
+class QuantileWindow
+{
+	public:
+		void		init(double window);
+		void		add(double value, double timestamp);
+		bool		merge(const QuantileWindow& other);
+		void		save(std::string& data) const;
+		bool		load(const char *data, size_t length);
+		uint64_t	getCount(double timestamp) const;
+		double		quantile(double q, double timestamp) const;
+		double		getWindow() const
+				{
+					return m_bucketLength * QUANTILE_WINDOW_BUCKETS;
+				};
+
+	private:
+		bool		isCurrent(int bucket, int64_t epoch) const
+				{
+					return m_epochs[bucket] > epoch - QUANTILE_WINDOW_BUCKETS &&
+					       m_epochs[bucket] <= epoch;
+				};
+		int64_t		epoch(double timestamp) const
+				{
+					return (int64_t)(timestamp / m_bucketLength);
+				};
+		static int	bucketOf(int64_t epoch)
+				{
+					return (int)(((epoch % QUANTILE_WINDOW_BUCKETS) +
+						      QUANTILE_WINDOW_BUCKETS) %
+						     QUANTILE_WINDOW_BUCKETS);
+				};
+		uint64_t	getCount(bool negative, int key, int64_t epoch) const;
+
+	private:
+		double		m_bucketLength;
+		int64_t		m_epochs[QUANTILE_WINDOW_BUCKETS];
+		QuantileSketch	m_buckets[QUANTILE_WINDOW_BUCKETS];
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef _READING_RING_H
+#define _READING_RING_H
+/*
+ * FogLAMP OutOfBound shared memory reading ring
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <string>
+#include <atomic>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define READING_RING_MAGIC	0x52424f4f	// "OOBR"
+#define READING_RING_VERSION	1
+
+/**
+ * Header of the shared memory segment, followed by slotCount slots.
+ *
+ * head and tail are monotonic sequence numbers:
+ * head is only written by the producer, tail only by the consumer.
+ * Each slot holds a 32 bit payload length followed by the
+ * NUL terminated JSON payload, the same document plugin_eval gets.
+ */
+struct ReadingRingHeader
+{
+	uint32_t			magic;
+	uint32_t			version;
+	uint32_t			slotCount;
+	uint32_t			slotSize;
+	alignas(64) std::atomic<uint64_t>	head;
+	alignas(64) std::atomic<uint64_t>	tail;
+	// Rule state, written by the consumer on state change only
+	alignas(64) std::atomic<uint64_t>	stateSequence;
+	std::atomic<uint32_t>		state;
+};
+
+/**
+ * Single producer, single consumer ring of readings
+ * in POSIX shared memory
+ */
+class ReadingRing
+{
+	public:
+		ReadingRing(const std::string& name);
+		virtual ~ReadingRing();
+
+		bool			isMapped() const { return m_header != NULL; };
+		const std::string&	getName() const { return m_name; };
+		bool			isCurrent() const;
+
+	protected:
+		bool			create(uint32_t slotCount, uint32_t slotSize);
+		bool			attach();
+		void			detach();
+		char			*slot(uint64_t sequence) const
+					{
+						return m_slots + (sequence & (m_slotCount - 1)) *
+							m_slotSize;
+					};
+
+	protected:
+		std::string		m_name;
+		ReadingRingHeader	*m_header;
+		char			*m_slots;
+		// Slot geometry, checked when mapped: the header is writable
+		// by the other process
+		uint32_t		m_slotCount;
+		uint32_t		m_slotSize;
+		size_t			m_size;
+		ino_t			m_inode;
+};
+
+/**
+ * Producer side: the local library used to feed readings
+ * to an OutOfBound rule instance configured with the same ring name
+ */
+class ReadingRingProducer : public ReadingRing
+{
+	public:
+		ReadingRingProducer(const std::string& name,
+				    uint32_t slotCount,
+				    uint32_t slotSize);
+		~ReadingRingProducer();
+
+		bool		push(const char *payload, size_t length);
+		bool		push(const std::string& payload)
+				{
+					return push(payload.c_str(), payload.length());
+				};
+		bool		stateChanged(bool& triggered);
+
+	private:
+		uint64_t	m_stateSequence;
+};
+
+/**
+ * Consumer side, used by the OutOfBound rule
+ */
+class ReadingRingConsumer : public ReadingRing
+{
+	public:
+		ReadingRingConsumer(const std::string& name);
+
+		bool		open() { return isMapped() || attach(); };
+		char		*front(size_t& length);
+		void		pop();
+		void		reportState(bool triggered);
+		bool		detachStale();
+};
+
+#endif
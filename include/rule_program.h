@@ -0,0 +1,1057 @@
+#ifndef _RULE_PROGRAM_H
+#define _RULE_PROGRAM_H
+/*
+ * FogLAMP OutOfBound compiled rule program
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <builtin_rule.h>
+#include "name_matcher.h"
+#include "datapoint_path.h"
+#include "expression.h"
+#include "running_stats.h"
+#include "quantile_sketch.h"
+#include "spectrum.h"
+
+// Largest n of the m_of_n qualifier
+#define MAX_SAMPLES	1024
+
+/**
+ * Datapoint check modes
+ *
+ * MODE_LIMIT:	the value is greater than trigger_value
+ * MODE_ZSCORE:	the value is more than trigger_value standard
+ *		deviations away from the running mean
+ * MODE_PERCENTILE:	the value is greater than the trigger_value
+ *		percentile of the values of a time window
+ * MODE_RATE:	the rate of change is greater than trigger_value,
+ *		see RateDirection
+ */
+enum DatapointMode
+{
+	MODE_LIMIT,
+	MODE_ZSCORE,
+	MODE_PERCENTILE,
+	MODE_RATE
+};
+
+/**
+ * Rate of change directions triggering in rate mode
+ *
+ * RATE_RISING:	the value increases faster than trigger_value
+ * RATE_FALLING:	the value decreases faster than trigger_value
+ * RATE_BOTH:	the value changes faster than trigger_value
+ */
+enum RateDirection
+{
+	RATE_RISING,
+	RATE_FALLING,
+	RATE_BOTH
+};
+
+/**
+ * Window aggregates computed by the rule from the "All"
+ * window values, for window_data options the notification
+ * service does not provide
+ *
+ * AGGREGATE_RMS:	root mean square of the window values
+ * AGGREGATE_PEAK_TO_PEAK:	maximum minus minimum
+ */
+enum WindowAggregate
+{
+	AGGREGATE_NONE,
+	AGGREGATE_RMS,
+	AGGREGATE_PEAK_TO_PEAK
+};
+
+/**
+ * A frequency band of the window spectrum and its energy bound
+ */
+struct EnergyBand
+{
+	double			low;		// Hz, included
+	double			high;		// Hz, excluded
+	double			limit;
+	bool			operator==(const EnergyBand& other) const
+				{
+					return low == other.low &&
+						high == other.high &&
+						limit == other.limit;
+				};
+};
+
+/**
+ * A datapoint check compiled from rule_config
+ *
+ * The datapoint name is a member of the asset object or
+ * a JSON pointer, see DatapointPath.
+ */
+class DatapointRule
+{
+	public:
+		DatapointRule(const std::string& name, double limit) :
+			m_name(name),
+			m_pattern(!isPath(name) && NameMatcher::isPattern(name)),
+			m_path(name),
+			m_mode(MODE_LIMIT), m_alpha(0), m_warmup(0), m_window(0),
+			m_period(1), m_smoothing(0), m_direction(RATE_RISING),
+			m_sustainedFor(0),
+			m_minSamples(0), m_samples(0), m_sampleRate(0), m_limit(limit) {};
+
+		static bool		isPath(const std::string& name)
+					{
+						return DatapointPath::isPath(name);
+					};
+		/**
+		 * Return the datapoint value of an asset
+		 *
+		 * @param    asset	The asset object
+		 * @return		The value or NULL if not found
+		 */
+		const Value		*find(const Value& asset) const
+					{
+						return m_path.find(asset);
+					};
+
+		const std::string&	getName() const { return m_name; };
+		// The name is a glob pattern of datapoint names
+		bool			isPattern() const { return m_pattern; };
+		double			getLimit() const { return m_limit; };
+		void			setLimit(double limit) { m_limit = limit; };
+		bool			operator==(const DatapointRule& other) const
+					{
+						return m_name == other.m_name &&
+							m_mode == other.m_mode &&
+							m_alpha == other.m_alpha &&
+							m_warmup == other.m_warmup &&
+							m_window == other.m_window &&
+							m_period == other.m_period &&
+							m_smoothing == other.m_smoothing &&
+							m_direction == other.m_direction &&
+							m_sustainedFor == other.m_sustainedFor &&
+							m_minSamples == other.m_minSamples &&
+							m_samples == other.m_samples &&
+							getExpressionSource() == other.getExpressionSource() &&
+							m_components == other.m_components &&
+							m_sampleRate == other.m_sampleRate &&
+							m_bands == other.m_bands &&
+							m_limit == other.m_limit;
+					};
+
+		/**
+		 * Check the value of an expression over other
+		 * datapoints instead of the named datapoint
+		 *
+		 * @param    expression	The compiled expression
+		 */
+		void			setExpression(std::shared_ptr<const Expression> expression)
+					{
+						m_expression = expression;
+						m_pattern = false;
+					};
+		const Expression	*getExpression() const { return m_expression.get(); };
+		std::string		getExpressionSource() const
+					{
+						return m_expression ? m_expression->getSource() : "";
+					};
+		/**
+		 * Check the magnitude of the vector of the
+		 * component datapoints instead of the named datapoint
+		 *
+		 * @param    components	The component datapoints
+		 */
+		void			setMagnitude(const std::vector<DatapointPath>& components)
+					{
+						m_components = components;
+						m_pattern = false;
+					};
+		bool			isMagnitude() const { return !m_components.empty(); };
+		const std::vector<DatapointPath>&
+					getComponents() const { return m_components; };
+		/**
+		 * Check the energy of frequency bands of the
+		 * spectrum of the window values
+		 *
+		 * @param    sampleRate	The window sample rate, in Hz
+		 * @param    bands	The bands and their bounds
+		 */
+		void			setBandEnergy(double sampleRate,
+						      const std::vector<EnergyBand>& bands)
+					{
+						m_sampleRate = sampleRate;
+						m_bands = bands;
+					};
+		bool			isBandEnergy() const { return !m_bands.empty(); };
+		double			getSampleRate() const { return m_sampleRate; };
+		const std::vector<EnergyBand>&
+					getBands() const { return m_bands; };
+		// The value is computed from other datapoints
+		bool			isDerived() const
+					{
+						return m_expression || !m_components.empty();
+					};
+		// The datapoints a derived value is computed from
+		const std::vector<DatapointPath>&
+					getOperands() const
+					{
+						return m_expression ?
+							m_expression->getOperands() :
+							m_components;
+					};
+
+		DatapointMode		getMode() const { return m_mode; };
+		// Modes and qualifiers keeping a state of previous values
+		bool			isStateful() const
+					{
+						return m_mode != MODE_LIMIT || hasQualifiers();
+					};
+		bool			hasQualifiers() const
+					{
+						return m_sustainedFor > 0 || m_samples > 0;
+					};
+		// Trigger only if the check is true for the given seconds
+		void			setSustainedFor(double seconds) { m_sustainedFor = seconds; };
+		double			getSustainedFor() const { return m_sustainedFor; };
+		// Trigger only if the check is true for m of the last n readings
+		void			setMOfN(unsigned int m, unsigned int n)
+					{
+						m_minSamples = m;
+						m_samples = n;
+					};
+		unsigned int		getMinSamples() const { return m_minSamples; };
+		unsigned int		getSamples() const { return m_samples; };
+		/**
+		 * Compare values to the running mean
+		 *
+		 * @param    alpha	Weight of the newest value,
+		 *			0 for equally weighted values
+		 * @param    warmup	Values to collect before triggering
+		 */
+		void			setZScore(double alpha, unsigned long warmup)
+					{
+						m_mode = MODE_ZSCORE;
+						m_alpha = alpha;
+						m_warmup = warmup;
+					};
+		/**
+		 * Compare values to a percentile of a time window
+		 *
+		 * @param    window	The window length in seconds
+		 * @param    warmup	Values to collect before triggering
+		 */
+		void			setPercentile(double window, unsigned long warmup)
+					{
+						m_mode = MODE_PERCENTILE;
+						m_window = window;
+						m_warmup = warmup;
+					};
+		/**
+		 * Compare the rate of change of the values
+		 *
+		 * @param    period	The rate period in seconds:
+		 *			60 for a change per minute
+		 * @param    smoothing	The smoothing time constant in
+		 *			seconds, 0 for no smoothing
+		 * @param    direction	The changes which trigger
+		 */
+		void			setRate(double period,
+						double smoothing,
+						RateDirection direction)
+					{
+						m_mode = MODE_RATE;
+						m_period = period;
+						m_smoothing = smoothing;
+						m_direction = direction;
+					};
+		double			getPeriod() const { return m_period; };
+		double			getSmoothing() const { return m_smoothing; };
+		RateDirection		getDirection() const { return m_direction; };
+		double			getAlpha() const { return m_alpha; };
+		unsigned long		getWarmup() const { return m_warmup; };
+		double			getWindow() const { return m_window; };
+
+	private:
+		std::string		m_name;
+		bool			m_pattern;
+		DatapointPath		m_path;
+		DatapointMode		m_mode;
+		double			m_alpha;
+		unsigned long		m_warmup;
+		double			m_window;
+		double			m_period;
+		double			m_smoothing;
+		RateDirection		m_direction;
+		double			m_sustainedFor;
+		unsigned int		m_minSamples;
+		unsigned int		m_samples;
+		std::shared_ptr<const Expression>
+					m_expression;
+		std::vector<DatapointPath>
+					m_components;
+		double			m_sampleRate;
+		std::vector<EnergyBand>	m_bands;
+		double			m_limit;
+};
+
+/**
+ * Runtime state of the datapoint check qualifiers,
+ * saved in the state snapshot
+ */
+struct QualifierState
+{
+	// Timestamp of the first of consecutive true checks, 0 if false
+	double			since;
+	// Ring of the last m_of_n results and number of true ones
+	uint64_t		results[MAX_SAMPLES / 64];
+	uint32_t		samples;	// n of the results
+	uint32_t		position;
+	uint32_t		count;
+	uint32_t		pad;
+};
+
+/**
+ * Runtime state of a datapoint check with a stateful mode
+ */
+struct DatapointState
+{
+	DatapointState() { memset(&qualifiers, 0, sizeof(qualifiers)); };
+
+	RunningStats		stats;
+	RateOfChange		rate;
+	QualifierState		qualifiers;
+	// Allocated by the first value in percentile mode
+	std::unique_ptr<QuantileWindow>
+				quantiles;
+};
+
+/**
+ * A scalar datapoint value compared by the unchanged value memoization
+ */
+struct MemoValue
+{
+	enum Kind { MISSING, NUMBER, OTHER };
+
+	Kind			kind;
+	double			value;
+
+	bool			operator==(const MemoValue& other) const
+				{
+					return kind == other.kind && value == other.value;
+				};
+};
+
+/**
+ * Runtime state of an asset rule
+ *
+ * The state mutex protects the updates of the state:
+ * evaluations of a stateful asset rule are serialised,
+ * the others only lock to read or set the memoised result.
+ */
+class AssetState
+{
+	public:
+		AssetState() : m_memoValid(false), m_memoResult(false),
+				m_memoCause(-1), m_memoValue(0),
+				m_memoRevision(0), m_revisions(0),
+				m_latestTimestamp(0), m_latestResult(false),
+				m_latestCause(-1), m_latestValue(0) {};
+
+		std::mutex&		getMutex() { return m_mutex; };
+		// One per datapoint rule, for stateful modes
+		std::vector<DatapointState>&
+					getDatapointStates() { return m_datapointStates; };
+
+		/**
+		 * Unchanged value memoization: return the memoised
+		 * result if the datapoint values are the same
+		 * and it was set by the same revision of the rule
+		 *
+		 * @param    revision	The asset rule revision
+		 * @param    values	The scalar datapoint values
+		 * @param    result	Set to the memoised result
+		 * @param    cause	Set to the triggering datapoint index
+		 * @param    value	Set to the triggering value
+		 * @return		True if the values are unchanged
+		 */
+		bool			findMemo(uint64_t revision,
+						 const std::vector<MemoValue>& values,
+						 bool& result,
+						 int& cause,
+						 double& value) const
+					{
+						if (!m_memoValid ||
+						    revision != m_memoRevision ||
+						    values != m_memoValues)
+						{
+							return false;
+						}
+						result = m_memoResult;
+						cause = m_memoCause;
+						value = m_memoValue;
+						return true;
+					};
+		void			setMemo(uint64_t revision,
+						const std::vector<MemoValue>& values,
+						bool result,
+						int cause,
+						double value)
+					{
+						m_memoRevision = revision;
+						m_memoValues = values;
+						m_memoResult = result;
+						m_memoCause = cause;
+						m_memoValue = value;
+						m_memoValid = true;
+					};
+		// A new revision of the rule, with updated limits:
+		// results memoised by the previous ones are not used
+		uint64_t		newRevision() { return ++m_revisions; };
+
+		// Latest result, for assets missing from the notification data
+		bool			isLatestTriggered(double since, int& cause, double& value) const
+					{
+						cause = m_latestCause;
+						value = m_latestValue;
+						return m_latestResult &&
+							m_latestTimestamp > 0 &&
+							m_latestTimestamp >= since;
+					};
+		void			setLatest(bool result, double timestamp, int cause, double value)
+					{
+						if (timestamp < m_latestTimestamp)
+						{
+							// Older reading, evaluated out of order
+							return;
+						}
+						m_latestResult = result;
+						m_latestTimestamp = timestamp;
+						m_latestCause = cause;
+						m_latestValue = value;
+					};
+
+	private:
+		std::mutex		m_mutex;
+		std::vector<DatapointState>
+					m_datapointStates;
+		std::vector<MemoValue>	m_memoValues;
+		bool			m_memoValid;
+		bool			m_memoResult;
+		int			m_memoCause;
+		double			m_memoValue;
+		uint64_t		m_memoRevision;
+		uint64_t		m_revisions;
+		double			m_latestTimestamp;
+		bool			m_latestResult;
+		int			m_latestCause;
+		double			m_latestValue;
+};
+
+/**
+ * All the datapoint checks of one asset
+ */
+class AssetRule
+{
+	public:
+		AssetRule(const std::string& asset,
+			  bool evalAll,
+			  const std::string& evaluation = "",
+			  unsigned int interval = 0) :
+			m_asset(asset),
+			m_pattern(NameMatcher::isPattern(asset)),
+			m_timestampName("timestamp_" + asset),
+			m_evalAll(evalAll),
+			m_aggregate(aggregateOf(evaluation)),
+			m_evaluation(m_aggregate != AGGREGATE_NONE ? "All" : evaluation),
+			m_interval(interval),
+			m_stateful(false),
+			m_state(new AssetState()),
+			m_revision(0) {};
+
+		const std::string&	getAsset() const { return m_asset; };
+		// The name is a glob pattern of asset names
+		bool			isPattern() const { return m_pattern; };
+		const std::string&	getTimestampName() const { return m_timestampName; };
+		bool			evalAllDatapoints() const { return m_evalAll; };
+		// Window evaluation requested to the notification service
+		const std::string&	getEvaluation() const { return m_evaluation; };
+		// Aggregate of the "All" window values computed by the rule
+		WindowAggregate		getAggregate() const { return m_aggregate; };
+		static WindowAggregate	aggregateOf(const std::string& evaluation)
+					{
+						if (evaluation.compare("RMS") == 0)
+						{
+							return AGGREGATE_RMS;
+						}
+						if (evaluation.compare("PeakToPeak") == 0)
+						{
+							return AGGREGATE_PEAK_TO_PEAK;
+						}
+						return AGGREGATE_NONE;
+					};
+		unsigned int		getInterval() const { return m_interval; };
+		const std::vector<DatapointRule>&
+					getDatapoints() const { return m_datapoints; };
+		std::vector<DatapointRule>&
+					getDatapoints() { return m_datapoints; };
+		void			addDatapoint(const DatapointRule& datapoint)
+					{
+						m_datapoints.push_back(datapoint);
+						m_stateful = m_stateful || datapoint.isStateful();
+					};
+		// Results depend on previous values: no memoization
+		bool			isStateful() const { return m_stateful; };
+		void			reserve(size_t datapoints)
+					{
+						m_datapoints.reserve(m_datapoints.size() + datapoints);
+					};
+		// Datapoint patterns, the match ids are datapoint indexes
+		void			compilePatterns()
+					{
+						for (size_t i = 0; i < m_datapoints.size(); i++)
+						{
+							if (m_datapoints[i].isPattern())
+							{
+								m_datapointMatcher.add(m_datapoints[i].getName(), i);
+							}
+						}
+						m_datapointMatcher.compile();
+					};
+		bool			hasDatapointPatterns() const
+					{
+						return !m_datapointMatcher.empty();
+					};
+		const NameMatcher&	getDatapointMatcher() const { return m_datapointMatcher; };
+		AssetState&		getState() const { return *m_state; };
+		// Revision of the limits, for the memoised results in the state
+		uint64_t		getRevision() const { return m_revision; };
+		void			newRevision()
+					{
+						std::lock_guard<std::mutex> guard(m_state->getMutex());
+						m_revision = m_state->newRevision();
+					};
+		bool			sameDefinition(const AssetRule& other) const
+					{
+						return m_asset == other.m_asset &&
+							m_evalAll == other.m_evalAll &&
+							m_aggregate == other.m_aggregate &&
+							m_evaluation == other.m_evaluation &&
+							m_interval == other.m_interval &&
+							m_datapoints == other.m_datapoints;
+					};
+
+	private:
+		std::string		m_asset;
+		bool			m_pattern;
+		std::string		m_timestampName;
+		bool			m_evalAll;
+		WindowAggregate		m_aggregate;
+		std::string		m_evaluation;
+		unsigned int		m_interval;
+		std::vector<DatapointRule>
+					m_datapoints;
+		bool			m_stateful;
+		NameMatcher		m_datapointMatcher;
+		std::shared_ptr<AssetState>
+					m_state;
+		uint64_t		m_revision;
+};
+
+/**
+ * The datapoint value which made an asset rule trigger,
+ * set by the evaluation with no copies
+ */
+struct EvalCause
+{
+	const AssetRule		*asset;
+	const DatapointRule	*datapoint;
+	double			value;
+	// Matched asset and datapoint names, if the rule names are patterns
+	const char		*assetName;
+	const char		*datapointName;
+};
+
+class RuleProgram;
+
+/**
+ * Trigger cause kept in the rule set state
+ *
+ * The asset and datapoint rules point into the rule program
+ * of the evaluation. Names are only copied if they are not the
+ * rule names: names matched by a pattern, causes restored from
+ * the state snapshot and causes of a deleted rule program.
+ */
+struct TriggerCause
+{
+	bool			valid;
+	const RuleProgram	*program;
+	const AssetRule		*asset;
+	const DatapointRule	*datapoint;
+	std::string		assetName;
+	std::string		datapointName;
+	double			value;
+	double			threshold;
+
+	const std::string&	getAsset() const
+				{
+					return asset && assetName.empty() ?
+						asset->getAsset() : assetName;
+				};
+	const std::string&	getDatapoint() const
+				{
+					return datapoint && datapointName.empty() ?
+						datapoint->getName() : datapointName;
+				};
+};
+
+/**
+ * Rule set state record saved in the state snapshot,
+ * followed by the cause asset and datapoint names
+ */
+struct RuleSetRecord
+{
+	double			timestamp;
+	double			holdUntil;
+	double			value;
+	double			threshold;
+	uint32_t		assetLength;
+	uint32_t		datapointLength;
+	uint8_t			triggered;
+	uint8_t			armed;
+	uint8_t			valid;
+	uint8_t			pad[5];
+};
+
+/**
+ * Runtime state of a rule set
+ *
+ * The state survives reconfigurations: a new program
+ * reuses the state of the rule set with the same id.
+ * Its updates are serialised by the state mutex.
+ */
+class RuleSetState
+{
+	public:
+		// State kept by the given rule, the OutOfBound handle itself
+		RuleSetState(BuiltinRule *rule) :
+			m_rule(rule), m_owned(false), m_timestamp(0), m_triggered(false),
+			m_armed(true), m_holdUntil(0)
+		{
+			m_cause.valid = false;
+			m_cause.program = NULL;
+			m_cause.asset = NULL;
+			m_cause.datapoint = NULL;
+		};
+		RuleSetState() :
+			m_rule(new BuiltinRule()), m_owned(true), m_timestamp(0), m_triggered(false),
+			m_armed(true), m_holdUntil(0)
+		{
+			m_cause.valid = false;
+			m_cause.program = NULL;
+			m_cause.asset = NULL;
+			m_cause.datapoint = NULL;
+		};
+		~RuleSetState()
+		{
+			if (m_owned)
+			{
+				m_rule->removeTriggers();
+				delete m_rule;
+			}
+		};
+
+		std::mutex&		getMutex() { return m_mutex; };
+		BuiltinRule		*getRule() const { return m_rule; };
+		double			getTimestamp() const { return m_timestamp; };
+		void			setTimestamp(double timestamp) { m_timestamp = timestamp; };
+		bool			isTriggered() const { return m_triggered; };
+		void			setTriggered(bool triggered) { m_triggered = triggered; };
+		bool			isArmed() const { return m_armed; };
+		void			setArmed(bool armed) { m_armed = armed; };
+		double			getHoldUntil() const { return m_holdUntil; };
+		void			setHoldUntil(double timestamp) { m_holdUntil = timestamp; };
+		const TriggerCause&	getCause() const { return m_cause; };
+		void			save(std::string& record) const
+					{
+						RuleSetRecord header;
+						memset(&header, 0, sizeof(header));
+						header.timestamp = m_timestamp;
+						header.holdUntil = m_holdUntil;
+						header.triggered = m_triggered;
+						header.armed = m_armed;
+						if (m_cause.valid)
+						{
+							header.valid = 1;
+							header.value = m_cause.value;
+							header.threshold = m_cause.threshold;
+							header.assetLength = m_cause.getAsset().length();
+							header.datapointLength = m_cause.getDatapoint().length();
+						}
+						record.assign((const char *)&header, sizeof(header));
+						if (m_cause.valid)
+						{
+							record += m_cause.getAsset();
+							record += m_cause.getDatapoint();
+						}
+					};
+		bool			restore(const char *record, uint32_t length)
+					{
+						const RuleSetRecord *header = (const RuleSetRecord *)record;
+						if (length < sizeof(RuleSetRecord) ||
+						    length - sizeof(RuleSetRecord) !=
+						    (uint64_t)header->assetLength + header->datapointLength)
+						{
+							return false;
+						}
+						m_timestamp = header->timestamp;
+						m_holdUntil = header->holdUntil;
+						m_triggered = header->triggered != 0;
+						m_armed = header->armed != 0;
+						m_cause.valid = header->valid != 0;
+						m_cause.program = NULL;
+						m_cause.asset = NULL;
+						m_cause.datapoint = NULL;
+						const char *names = record + sizeof(RuleSetRecord);
+						m_cause.assetName.assign(names, header->assetLength);
+						m_cause.datapointName.assign(names + header->assetLength,
+									     header->datapointLength);
+						m_cause.value = header->value;
+						m_cause.threshold = header->threshold;
+						return true;
+					};
+		void			setCause(const EvalCause& cause,
+						 const RuleProgram *program)
+					{
+						m_cause.program = program;
+						m_cause.asset = cause.asset;
+						m_cause.datapoint = cause.datapoint;
+						if (cause.assetName)
+						{
+							m_cause.assetName.assign(cause.assetName);
+						}
+						else
+						{
+							m_cause.assetName.clear();
+						}
+						if (cause.datapointName)
+						{
+							m_cause.datapointName.assign(cause.datapointName);
+						}
+						else
+						{
+							m_cause.datapointName.clear();
+						}
+						m_cause.value = cause.value;
+						m_cause.threshold = cause.datapoint->getLimit();
+						m_cause.valid = true;
+					};
+		void			setCause(const TriggerCause& cause) { m_cause = cause; };
+		// Copy the cause names before its rule program is deleted
+		void			detachCause(const RuleProgram *program)
+					{
+						if (m_cause.program != program)
+						{
+							return;
+						}
+						m_cause.assetName = m_cause.getAsset();
+						m_cause.datapointName = m_cause.getDatapoint();
+						m_cause.program = NULL;
+						m_cause.asset = NULL;
+						m_cause.datapoint = NULL;
+					};
+
+	private:
+		RuleSetState(const RuleSetState&);
+		RuleSetState&		operator=(const RuleSetState&);
+
+	private:
+		std::mutex		m_mutex;
+		BuiltinRule		*m_rule;
+		bool			m_owned;
+		double			m_timestamp;
+		bool			m_triggered;
+		bool			m_armed;
+		double			m_holdUntil;
+		TriggerCause		m_cause;
+};
+
+/**
+ * A set of asset rules with its own state, reason and id
+ */
+class RuleSet
+{
+	public:
+		RuleSet(const std::string& id,
+			std::shared_ptr<RuleSetState> state) :
+			m_id(id), m_state(state), m_program(NULL),
+			m_edgeTriggered(false), m_rearm(true), m_holdOff(0),
+			m_maxAge(0) {};
+
+		const std::string&	getId() const { return m_id; };
+		// The rule program of the rule set
+		const RuleProgram	*getProgram() const { return m_program; };
+		void			setProgram(const RuleProgram *program) { m_program = program; };
+		RuleSetState		*getState() const { return m_state.get(); };
+		const std::shared_ptr<RuleSetState>&
+					getSharedState() const { return m_state; };
+		void			reserve(size_t assets)
+					{
+						m_assets.reserve(assets);
+						m_assetIndex.reserve(assets);
+					};
+		AssetRule&		addAsset(const std::string& asset,
+						 bool evalAll,
+						 const std::string& evaluation,
+						 unsigned int interval,
+						 bool& created)
+					{
+						auto it = m_assetIndex.find(asset);
+						created = it == m_assetIndex.end();
+						if (!created)
+						{
+							return m_assets[(*it).second];
+						}
+						m_assetIndex[asset] = m_assets.size();
+						m_assets.push_back(AssetRule(asset,
+									     evalAll,
+									     evaluation,
+									     interval));
+						return m_assets.back();
+					};
+		std::vector<AssetRule>&	getAssets() { return m_assets; };
+		const AssetRule		*findAsset(const std::string& asset) const
+					{
+						auto it = m_assetIndex.find(asset);
+						return it == m_assetIndex.end() ?
+							NULL : &m_assets[(*it).second];
+					};
+		AssetRule		*findAsset(const std::string& asset)
+					{
+						auto it = m_assetIndex.find(asset);
+						return it == m_assetIndex.end() ?
+							NULL : &m_assets[(*it).second];
+					};
+		// Compare the name in place, with no key to build
+		bool			hasAsset(const char *asset, size_t length) const
+					{
+						for (auto& rule : m_assets)
+						{
+							const std::string& name = rule.getAsset();
+							if (name.length() == length &&
+							    !rule.isPattern() &&
+							    memcmp(name.c_str(), asset, length) == 0)
+							{
+								return true;
+							}
+						}
+						return false;
+					};
+		const std::vector<AssetRule>&
+					getAssets() const { return m_assets; };
+		/**
+		 * Compile the asset and datapoint patterns, the asset
+		 * match ids are asset indexes.
+		 *
+		 * The asset rules with the same definition in the previous
+		 * rule set are copied with their compiled patterns and
+		 * share its state. The asset matcher is copied if the
+		 * asset patterns are the same, at the same indexes.
+		 *
+		 * @param    previous	The rule set replaced, or NULL
+		 * @return		The number of unchanged asset rules
+		 */
+		size_t			compilePatterns(const RuleSet *previous)
+					{
+						size_t kept = 0;
+						bool samePatterns = previous != NULL;
+						for (size_t i = 0; i < m_assets.size(); i++)
+						{
+							const AssetRule *current = previous ?
+								previous->findAsset(m_assets[i].getAsset()) :
+								NULL;
+							if (current && current->sameDefinition(m_assets[i]))
+							{
+								m_assets[i] = *current;
+								kept++;
+							}
+							else
+							{
+								m_assets[i].compilePatterns();
+							}
+							if (m_assets[i].isPattern() ||
+							    (previous &&
+							     i < previous->m_assets.size() &&
+							     previous->m_assets[i].isPattern()))
+							{
+								samePatterns = samePatterns &&
+									current == &previous->m_assets[i];
+							}
+						}
+						if (samePatterns)
+						{
+							for (size_t i = m_assets.size(); i < previous->m_assets.size(); i++)
+							{
+								samePatterns = samePatterns &&
+									!previous->m_assets[i].isPattern();
+							}
+						}
+						if (samePatterns)
+						{
+							m_assetMatcher = previous->m_assetMatcher;
+							return kept;
+						}
+						for (size_t i = 0; i < m_assets.size(); i++)
+						{
+							if (m_assets[i].isPattern())
+							{
+								m_assetMatcher.add(m_assets[i].getAsset(), i);
+							}
+						}
+						m_assetMatcher.compile();
+						return kept;
+					};
+		bool			hasAssetPatterns() const { return !m_assetMatcher.empty(); };
+		const NameMatcher&	getAssetMatcher() const { return m_assetMatcher; };
+
+		// Edge triggered: only the cleared to triggered transition is reported
+		bool			isEdgeTriggered() const { return m_edgeTriggered; };
+		bool			rearmAfterClear() const { return m_rearm; };
+		void			setEdgeTriggered(bool edge, bool rearm)
+					{
+						m_edgeTriggered = edge;
+						m_rearm = rearm;
+					};
+
+		// Seconds without evaluations after a trigger
+		double			getHoldOff() const { return m_holdOff; };
+		void			setHoldOff(double holdOff) { m_holdOff = holdOff; };
+
+		// Seconds the latest result of a missing asset is used, 0 for never
+		double			getMaxAge() const { return m_maxAge; };
+		void			setMaxAge(double maxAge) { m_maxAge = maxAge; };
+
+	private:
+		std::string		m_id;
+		std::shared_ptr<RuleSetState>
+					m_state;
+		const RuleProgram	*m_program;
+		std::vector<AssetRule>	m_assets;
+		std::unordered_map<std::string, size_t>
+					m_assetIndex;
+		NameMatcher		m_assetMatcher;
+		bool			m_edgeTriggered;
+		bool			m_rearm;
+		double			m_holdOff;
+		double			m_maxAge;
+};
+
+/**
+ * The compiled rule program
+ *
+ * Built by OutOfBound::configure(), or copied and patched by
+ * OutOfBound::updateThresholds(), and never changed once in use:
+ * a new program replaces the current one, so evaluations in
+ * progress keep using the one they started with.
+ *
+ * The first rule set is the one defined by the "rules" array,
+ * with an empty id; the others come from the "rule_sets" array.
+ */
+class RuleProgram
+{
+	public:
+		RuleProgram() : m_hash(0) {};
+		// A copy sharing the rule set and asset rule states
+		RuleProgram		*clone() const
+					{
+						RuleProgram *program = new RuleProgram(*this);
+						for (auto& ruleSet : program->m_ruleSets)
+						{
+							ruleSet.setProgram(program);
+						}
+						return program;
+					};
+		// The trigger causes no longer point into the program
+		~RuleProgram()
+		{
+			for (auto& ruleSet : m_ruleSets)
+			{
+				RuleSetState *state = ruleSet.getState();
+				std::lock_guard<std::mutex> guard(state->getMutex());
+				state->detachCause(this);
+			}
+		};
+
+		RuleSet&		addRuleSet(const std::string& id,
+						   std::shared_ptr<RuleSetState> state)
+					{
+						m_ruleSets.push_back(RuleSet(id, state));
+						m_ruleSets.back().setProgram(this);
+						return m_ruleSets.back();
+					};
+		const std::vector<RuleSet>&
+					getRuleSets() const { return m_ruleSets; };
+		std::vector<RuleSet>&	getRuleSets() { return m_ruleSets; };
+		// No "rules": the rule result is true if any rule set triggered
+		bool			isAnyRuleSet() const
+					{
+						return m_ruleSets.size() > 1 &&
+							m_ruleSets.front().getAssets().empty();
+					};
+		const RuleSet		*findRuleSet(const std::string& id) const
+					{
+						for (auto& r : m_ruleSets)
+						{
+							if (r.getId().compare(id) == 0)
+							{
+								return &r;
+							}
+						}
+						return NULL;
+					};
+		RuleSet			*findRuleSet(const std::string& id)
+					{
+						for (auto& r : m_ruleSets)
+						{
+							if (r.getId().compare(id) == 0)
+							{
+								return &r;
+							}
+						}
+						return NULL;
+					};
+		// Asset names the asset patterns are expanded to in the triggers
+		void			addKnownAsset(const std::string& asset)
+					{
+						m_knownAssets.push_back(asset);
+					};
+		const std::vector<std::string>&
+					getKnownAssets() const { return m_knownAssets; };
+		// Hash of the rule configuration, kept in the state snapshot
+		uint64_t		getHash() const { return m_hash; };
+		void			setHash(uint64_t hash) { m_hash = hash; };
+
+	private:
+		std::vector<RuleSet>	m_ruleSets;
+		std::vector<std::string>
+					m_knownAssets;
+		uint64_t		m_hash;
+
+	private:
+		RuleProgram(const RuleProgram& other) :
+			m_ruleSets(other.m_ruleSets),
+			m_knownAssets(other.m_knownAssets),
+			m_hash(other.m_hash) {};
+		RuleProgram&		operator=(const RuleProgram&);
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef _RUNNING_STATS_H
+#define _RUNNING_STATS_H
+/*
+ * FogLAMP OutOfBound running datapoint statistics
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <math.h>
+
+/**
+ * Running mean and variance of a datapoint, in constant memory
+ *
+ * With alpha 0 all the values have the same weight (Welford),
+ * otherwise the statistics are exponentially weighted and
+ * alpha is the weight of the newest value.
+ */
+class RunningStats
+{
+	public:
+		RunningStats() : m_count(0), m_mean(0), m_m2(0) {};
+
+		unsigned long	getCount() const { return m_count; };
+		double		getMean() const { return m_mean; };
+		double		getStdDev(double alpha) const
+				{
+					if (alpha > 0)
+					{
+						return sqrt(m_m2);
+					}
+					return m_count > 1 ? sqrt(m_m2 / (m_count - 1)) : 0;
+				};
+		void		add(double value, double alpha)
+				{
+					double delta = value - m_mean;
+					m_count++;
+					if (alpha > 0)
+					{
+						if (m_count == 1)
+						{
+							m_mean = value;
+							return;
+						}
+						// m_m2 is the variance
+						m_mean += alpha * delta;
+						m_m2 = (1 - alpha) * (m_m2 + alpha * delta * delta);
+					}
+					else
+					{
+						m_mean += delta / m_count;
+						m_m2 += delta * (value - m_mean);
+					}
+				};
+
+	private:
+		unsigned long	m_count;
+		double		m_mean;
+		double		m_m2;
+};
+
+/**
+ * Rate of change of a datapoint, from consecutive values
+ * and their reading timestamps
+ *
+ * With smoothing 0 the rate is the slope between the last
+ * two values, otherwise it is exponentially smoothed with
+ * the smoothing time constant, in seconds.
+ */
+class RateOfChange
+{
+	public:
+		RateOfChange() : m_count(0), m_value(0), m_timestamp(0), m_rate(0) {};
+
+		// Number of values, there is a rate from the second one
+		unsigned long	getCount() const { return m_count; };
+		double		getRate() const { return m_rate; };
+		/**
+		 * Add a value
+		 *
+		 * @param    value	The value
+		 * @param    timestamp	The reading timestamp
+		 * @param    smoothing	The smoothing time constant
+		 * @return		False if the value is not newer
+		 *			than the previous one
+		 */
+		bool		add(double value, double timestamp, double smoothing)
+				{
+					if (m_count > 0)
+					{
+						double elapsed = timestamp - m_timestamp;
+						if (elapsed <= 0)
+						{
+							return false;
+						}
+						double rate = (value - m_value) / elapsed;
+						if (smoothing > 0 && m_count > 1)
+						{
+							m_rate += (1 - exp(-elapsed / smoothing)) * (rate - m_rate);
+						}
+						else
+						{
+							m_rate = rate;
+						}
+					}
+					m_value = value;
+					m_timestamp = timestamp;
+					m_count++;
+					return true;
+				};
+
+	private:
+		unsigned long	m_count;
+		double		m_value;
+		double		m_timestamp;
+		double		m_rate;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef _SPECTRUM_H
+#define _SPECTRUM_H
+/*
+ * FogLAMP OutOfBound window spectrum
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <vector>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest transform, longer windows are truncated
+#define FFT_MAX_SIZE	(1 << 20)
+
+/**
+ * Precomputed plan of a real FFT of a power of 2 size
+ *
+ * A real transform of size N is computed as a complex
+ * transform of size N/2 of the even and odd values,
+ * then split: the plan holds the bit reversal table,
+ * the complex transform twiddles and the split twiddles.
+ *
+ * Plans are immutable and shared by all the threads,
+ * one per size, see get().
+ */
+class FftPlan
+{
+	public:
+		FftPlan(size_t size);
+
+		static std::shared_ptr<const FftPlan>
+				get(size_t size);
+		// Real transform size
+		size_t		getSize() const { return m_size; };
+		void		transform(double *re, double *im) const;
+		double		getSplitCos(size_t k) const { return m_splitCos[k]; };
+		double		getSplitSin(size_t k) const { return m_splitSin[k]; };
+
+	private:
+		size_t		m_size;
+		std::vector<uint32_t>
+				m_reverse;	// Bit reversal of N/2 indexes
+		std::vector<double>
+				m_cos;		// exp(-2 pi i j / (N/2)), j < N/4
+		std::vector<double>
+				m_sin;
+		std::vector<double>
+				m_splitCos;	// exp(-2 pi i k / N), k <= N/2
+		std::vector<double>
+				m_splitSin;
+};
+
+/**
+ * One sided power spectrum of window values
+ *
+ * The values are zero padded to a power of 2. The power of a bin
+ * is scaled so that the sum of all the bins is the mean square
+ * of the values: a sine of amplitude A has an energy of A²/2.
+ *
+ * The buffers are kept between computations, so a spectrum
+ * per thread computes windows of the same size with no allocation.
+ */
+class Spectrum
+{
+	public:
+		Spectrum() : m_size(0) {};
+
+		void		compute(const double *values, size_t n);
+		double		bandEnergy(double low, double high, double sampleRate) const;
+
+	private:
+		std::shared_ptr<const FftPlan>
+				m_plan;
+		size_t		m_size;		// Transform size
+		std::vector<double>
+				m_re;
+		std::vector<double>
+				m_im;
+		std::vector<double>
+				m_power;	// N/2 + 1 bins
+};
+
+#endif
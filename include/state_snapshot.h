@@ -0,0 +1,88 @@
+#ifndef _STATE_SNAPSHOT_H
+#define _STATE_SNAPSHOT_H
+/*
+ * FogLAMP OutOfBound rule state snapshot
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+
+#define STATE_SNAPSHOT_MAGIC	"OOBSTATE"
+#define STATE_SNAPSHOT_VERSION	3
+
+/**
+ * Snapshot record kinds
+ */
+#define SNAPSHOT_RULE_SET	1
+#define SNAPSHOT_RUNNING_STATS	2
+#define SNAPSHOT_QUANTILES	3
+#define SNAPSHOT_RATE		4
+#define SNAPSHOT_QUALIFIERS	5
+
+/**
+ * Snapshot file header
+ */
+struct StateSnapshotHeader
+{
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	count;
+	uint64_t	length;
+	uint64_t	checksum;
+	uint64_t	program;	// Hash of the rule configuration
+};
+
+/**
+ * Snapshot record header, followed by length bytes of data
+ * and padded to 8 bytes
+ */
+struct StateSnapshotRecord
+{
+	uint32_t	kind;
+	uint32_t	length;
+	uint64_t	key;
+};
+
+/**
+ * Compact rule state saved to a versioned memory mapped file
+ *
+ * Records are identified by a kind and a key, a hash of the names
+ * of the rule set, asset and datapoint they belong to.
+ * Records of unknown kind or unexpected size are ignored on load,
+ * a different file version or rule configuration discards the whole
+ * snapshot.
+ */
+class StateSnapshot
+{
+	public:
+		StateSnapshot();
+		~StateSnapshot();
+
+		void		add(uint32_t kind, uint64_t key, const void *data, uint32_t length);
+		bool		save(const std::string& path, uint64_t program) const;
+
+		bool		load(const std::string& path, uint64_t program);
+		const void	*find(uint32_t kind, uint64_t key, uint32_t length) const;
+		const void	*findRecord(uint32_t kind, uint64_t key, uint32_t& length) const;
+
+		static uint64_t	key(const std::string& name, uint64_t parent = 0);
+
+	private:
+		static uint64_t	checksum(const char *data, size_t length);
+
+	private:
+		std::string	m_records;
+		uint32_t	m_count;
+		void		*m_map;
+		size_t		m_mapSize;
+		std::unordered_multimap<uint64_t, const StateSnapshotRecord *>
+				m_index;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _TIMESTAMP_FORMATTER_H
+#define _TIMESTAMP_FORMATTER_H
+/*
+ * FogLAMP OutOfBound UTC timestamp formatter
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <time.h>
+#include <stddef.h>
+
+/**
+ * Format reading timestamps as "YYYY-MM-DD HH:MM:SS.uuuuuu+00:00"
+ *
+ * The date and time part is formatted once per second:
+ * timestamps within the same second only rewrite
+ * the fractional part.
+ */
+class TimestampFormatter
+{
+	public:
+		TimestampFormatter() : m_second(-1), m_prefixLength(0) {};
+
+		const char	*format(double timestamp);
+
+	private:
+		time_t		m_second;
+		size_t		m_prefixLength;
+		char		m_buffer[48];
+};
+
+#endif
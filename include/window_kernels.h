@@ -0,0 +1,145 @@
+#ifndef _WINDOW_KERNELS_H
+#define _WINDOW_KERNELS_H
+/*
+ * FogLAMP OutOfBound window array kernels
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <stddef.h>
+
+/**
+ * Kernels over contiguous window values (window_data = All)
+ *
+ * The loops have no branches and no loop carried dependencies
+ * other than the reductions, so they are vectorized at -O3.
+ * Values must be numbers: non numeric values are dropped, or
+ * set to NaN, when the window arrays are copied.
+ */
+
+/**
+ * Add the squares of values to the sums
+ *
+ * @param    sums	The sums, updated
+ * @param    values	The values
+ * @param    n		The number of values
+ */
+inline void addSquares(double *sums, const double *values, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		sums[i] += values[i] * values[i];
+	}
+}
+
+/**
+ * Return the sum of values
+ *
+ * Four partial sums, so that the additions need
+ * not be in order and the loop is vectorized.
+ *
+ * @param    values	The values
+ * @param    n		The number of values
+ * @return		The sum
+ */
+inline double sumValues(const double *values, size_t n)
+{
+	double sums[4] = { 0, 0, 0, 0 };
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		sums[0] += values[i];
+		sums[1] += values[i + 1];
+		sums[2] += values[i + 2];
+		sums[3] += values[i + 3];
+	}
+	for (; i < n; i++)
+	{
+		sums[0] += values[i];
+	}
+	return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+/**
+ * Return the squared root mean square of magnitudes
+ * from their squares: the mean of the squares
+ *
+ * @param    squares	The squared magnitudes, n > 0
+ * @param    n		The number of magnitudes
+ * @return		The squared root mean square
+ */
+inline double squaredRms(const double *squares, size_t n)
+{
+	return sumValues(squares, n) / n;
+}
+
+/**
+ * Return the sum of the squares of values
+ *
+ * Four partial sums, so that the additions need
+ * not be in order and the loop is vectorized.
+ *
+ * @param    values	The values
+ * @param    n		The number of values
+ * @return		The sum of the squares
+ */
+inline double sumSquares(const double *values, size_t n)
+{
+	double sums[4] = { 0, 0, 0, 0 };
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		sums[0] += values[i] * values[i];
+		sums[1] += values[i + 1] * values[i + 1];
+		sums[2] += values[i + 2] * values[i + 2];
+		sums[3] += values[i + 3] * values[i + 3];
+	}
+	for (; i < n; i++)
+	{
+		sums[0] += values[i] * values[i];
+	}
+	return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+/**
+ * Return the minimum and maximum of values, in one pass
+ *
+ * Four independent lanes with no branches, the
+ * comparisons compile to min and max instructions.
+ *
+ * @param    values	The values, n > 0
+ * @param    n		The number of values
+ * @param    low	Set to the minimum
+ * @param    high	Set to the maximum
+ */
+inline void minMax(const double *values, size_t n, double& low, double& high)
+{
+	double lows[4] = { values[0], values[0], values[0], values[0] };
+	double highs[4] = { values[0], values[0], values[0], values[0] };
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			lows[j] = values[i + j] < lows[j] ? values[i + j] : lows[j];
+			highs[j] = values[i + j] > highs[j] ? values[i + j] : highs[j];
+		}
+	}
+	for (; i < n; i++)
+	{
+		lows[0] = values[i] < lows[0] ? values[i] : lows[0];
+		highs[0] = values[i] > highs[0] ? values[i] : highs[0];
+	}
+	low = lows[0];
+	high = highs[0];
+	for (int j = 1; j < 4; j++)
+	{
+		low = lows[j] < low ? lows[j] : low;
+		high = highs[j] > high ? highs[j] : high;
+	}
+}
+
+#endif
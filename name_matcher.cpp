@@ -0,0 +1,815 @@
+/**
+ * FogLAMP OutOfBound asset and datapoint name patterns
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <map>
+#include <algorithm>
+#include <ctype.h>
+#include <stdlib.h>
+#include "name_matcher.h"
+
+using namespace std;
+
+/**
+ * Add a pattern
+ *
+ * @param    pattern	The glob pattern, or the regular
+ *			expression with the "re:" prefix
+ * @param    id		The id returned by match()
+ * @return		False if the pattern is invalid
+ */
+bool NameMatcher::add(const string& pattern, int id)
+{
+	size_t nodes = m_nodes.size();
+	Fragment fragment;
+	bool valid;
+	if (isRegex(pattern))
+	{
+		string re = pattern.substr(sizeof(NAME_MATCHER_REGEX) - 1);
+		size_t pos = 0;
+		valid = parseAlternation(re, pos, fragment) && pos == re.length();
+	}
+	else
+	{
+		valid = parseGlob(pattern, fragment);
+	}
+	if (!valid)
+	{
+		m_nodes.resize(nodes);
+		return false;
+	}
+
+	Pattern p;
+	p.id = id;
+	p.start = fragment.start;
+	p.accept = fragment.end;
+	m_accept.resize(m_nodes.size(), -1);
+	m_accept[fragment.end] = m_patterns.size();
+	m_patterns.push_back(p);
+	m_compiled = false;
+
+	return true;
+}
+
+/**
+ * Add an NFA node with no transitions
+ *
+ * @return		The node index
+ */
+int NameMatcher::addNode()
+{
+	Node node;
+	node.next = -1;
+	node.epsilon[0] = -1;
+	node.epsilon[1] = -1;
+	m_nodes.push_back(node);
+	return m_nodes.size() - 1;
+}
+
+/**
+ * Add a transition on no character
+ *
+ * @param    from	The source node, with a free transition
+ * @param    to		The target node
+ */
+void NameMatcher::link(int from, int to)
+{
+	Node& node = m_nodes[from];
+	node.epsilon[node.epsilon[0] < 0 ? 0 : 1] = to;
+}
+
+/**
+ * Return a fragment matching the empty name
+ */
+NameMatcher::Fragment NameMatcher::emptyFragment()
+{
+	Fragment fragment;
+	fragment.first = addNode();
+	fragment.start = fragment.first;
+	fragment.end = fragment.first;
+	return fragment;
+}
+
+/**
+ * Return a fragment matching one character of a set
+ *
+ * @param    set	The character set
+ */
+NameMatcher::Fragment NameMatcher::chars(const bitset<256>& set)
+{
+	Fragment fragment;
+	fragment.first = addNode();
+	fragment.start = fragment.first;
+	fragment.end = addNode();
+	m_nodes[fragment.start].chars = set;
+	m_nodes[fragment.start].next = fragment.end;
+	return fragment;
+}
+
+/**
+ * Append a fragment, added after the first one
+ *
+ * @param    fragment	The fragment, updated
+ * @param    next	The fragment to append
+ */
+void NameMatcher::concat(Fragment& fragment, const Fragment& next)
+{
+	link(fragment.end, next.start);
+	fragment.end = next.end;
+}
+
+/**
+ * Repeat a fragment zero or more times
+ *
+ * @param    fragment	The fragment, updated
+ */
+void NameMatcher::star(Fragment& fragment)
+{
+	int start = addNode();
+	int end = addNode();
+	link(start, fragment.start);
+	link(start, end);
+	link(fragment.end, start);
+	fragment.start = start;
+	fragment.end = end;
+}
+
+/**
+ * Make a fragment optional
+ *
+ * @param    fragment	The fragment, updated
+ */
+void NameMatcher::optional(Fragment& fragment)
+{
+	int start = addNode();
+	int end = addNode();
+	link(start, fragment.start);
+	link(start, end);
+	link(fragment.end, end);
+	fragment.start = start;
+	fragment.end = end;
+}
+
+/**
+ * Add a copy of a fragment
+ *
+ * @param    nodes	The fragment nodes, from its first one
+ * @param    fragment	The fragment
+ * @return		The copy
+ */
+NameMatcher::Fragment NameMatcher::copy(const vector<Node>& nodes, const Fragment& fragment)
+{
+	int offset = (int)m_nodes.size() - fragment.first;
+	for (auto node : nodes)
+	{
+		node.next = node.next < 0 ? -1 : node.next + offset;
+		for (int i = 0; i < 2; i++)
+		{
+			node.epsilon[i] = node.epsilon[i] < 0 ? -1 : node.epsilon[i] + offset;
+		}
+		m_nodes.push_back(node);
+	}
+	Fragment result;
+	result.first = fragment.first + offset;
+	result.start = fragment.start + offset;
+	result.end = fragment.end + offset;
+	return result;
+}
+
+/**
+ * Build the NFA of a glob pattern
+ *
+ * @param    pattern	The glob pattern
+ * @param    fragment	Set to the pattern NFA
+ * @return		False if the pattern has an unterminated class
+ */
+bool NameMatcher::parseGlob(const string& pattern, Fragment& fragment)
+{
+	fragment = emptyFragment();
+	bool afterStar = false;
+	for (size_t i = 0; i < pattern.length(); i++)
+	{
+		bitset<256> set;
+		unsigned char c = pattern[i];
+		if (c == '*')
+		{
+			// Consecutive stars are the same as one
+			if (!afterStar)
+			{
+				set.set();
+				Fragment any = chars(set);
+				star(any);
+				concat(fragment, any);
+				afterStar = true;
+			}
+			continue;
+		}
+		afterStar = false;
+		if (c == '?')
+		{
+			set.set();
+		}
+		else if (c == '[')
+		{
+			size_t j = i + 1;
+			bool negate = j < pattern.length() && pattern[j] == '!';
+			if (negate)
+			{
+				j++;
+			}
+			size_t start = j;
+			// A ']' right after '[' or '[!' is a member of the class
+			while (j < pattern.length() && (pattern[j] != ']' || j == start))
+			{
+				unsigned char from = pattern[j];
+				unsigned char to = from;
+				if (j + 2 < pattern.length() &&
+				    pattern[j + 1] == '-' &&
+				    pattern[j + 2] != ']')
+				{
+					to = pattern[j + 2];
+					j += 2;
+				}
+				for (unsigned int k = from; k <= to; k++)
+				{
+					set.set(k);
+				}
+				j++;
+			}
+			if (j >= pattern.length())
+			{
+				return false;
+			}
+			if (negate)
+			{
+				set.flip();
+			}
+			i = j;
+		}
+		else
+		{
+			set.set(c);
+		}
+		concat(fragment, chars(set));
+	}
+	return true;
+}
+
+/**
+ * alternation := sequence ('|' sequence)*
+ */
+bool NameMatcher::parseAlternation(const string& re, size_t& pos, Fragment& fragment)
+{
+	if (!parseSequence(re, pos, fragment))
+	{
+		return false;
+	}
+	while (pos < re.length() && re[pos] == '|')
+	{
+		pos++;
+		Fragment other;
+		if (!parseSequence(re, pos, other))
+		{
+			return false;
+		}
+		int start = addNode();
+		int end = addNode();
+		link(start, fragment.start);
+		link(start, other.start);
+		link(fragment.end, end);
+		link(other.end, end);
+		fragment.start = start;
+		fragment.end = end;
+	}
+	return true;
+}
+
+/**
+ * sequence := repeat*
+ *
+ * A leading '^' and a trailing '$' are accepted:
+ * the expression always matches the whole name.
+ */
+bool NameMatcher::parseSequence(const string& re, size_t& pos, Fragment& fragment)
+{
+	fragment = emptyFragment();
+	if (pos == 0 && pos < re.length() && re[pos] == '^')
+	{
+		pos++;
+	}
+	while (pos < re.length() && re[pos] != '|' && re[pos] != ')')
+	{
+		if (re[pos] == '$' && pos + 1 == re.length())
+		{
+			pos++;
+			break;
+		}
+		Fragment next;
+		if (!parseRepeat(re, pos, next))
+		{
+			return false;
+		}
+		concat(fragment, next);
+	}
+	return true;
+}
+
+/**
+ * repeat := atom ('*' | '+' | '?' | '{' m [',' [n]] '}')*
+ */
+bool NameMatcher::parseRepeat(const string& re, size_t& pos, Fragment& fragment)
+{
+	if (!parseAtom(re, pos, fragment))
+	{
+		return false;
+	}
+	while (pos < re.length())
+	{
+		char c = re[pos];
+		if (c == '*')
+		{
+			star(fragment);
+		}
+		else if (c == '+')
+		{
+			// One, then any number of copies
+			vector<Node> nodes(m_nodes.begin() + fragment.first, m_nodes.end());
+			Fragment more = copy(nodes, fragment);
+			star(more);
+			concat(fragment, more);
+		}
+		else if (c == '?')
+		{
+			optional(fragment);
+		}
+		else if (c == '{')
+		{
+			const char *start = re.c_str() + pos + 1;
+			char *end;
+			long min = strtol(start, &end, 10);
+			long max = min;
+			if (end == start || min < 0)
+			{
+				return false;
+			}
+			if (*end == ',')
+			{
+				start = end + 1;
+				max = strtol(start, &end, 10);
+				if (end == start)
+				{
+					max = -1;	// No maximum
+				}
+			}
+			if (*end != '}' ||
+			    min > NAME_MATCHER_MAX_REPEAT ||
+			    max > NAME_MATCHER_MAX_REPEAT ||
+			    (max >= 0 && max < min))
+			{
+				return false;
+			}
+			pos = end - re.c_str();
+
+			vector<Node> nodes(m_nodes.begin() + fragment.first, m_nodes.end());
+			Fragment atom = fragment;
+			fragment = emptyFragment();
+			for (long i = 0; i < min; i++)
+			{
+				concat(fragment, copy(nodes, atom));
+			}
+			if (max < 0)
+			{
+				Fragment more = copy(nodes, atom);
+				star(more);
+				concat(fragment, more);
+			}
+			for (long i = min; i < max; i++)
+			{
+				Fragment more = copy(nodes, atom);
+				optional(more);
+				concat(fragment, more);
+			}
+			// The nodes of the atom are not reachable
+			fragment.first = atom.first;
+		}
+		else
+		{
+			return true;
+		}
+		pos++;
+	}
+	return true;
+}
+
+/**
+ * atom := '(' alternation ')' | '[' class ']' | '.' | '\' escape | character
+ */
+bool NameMatcher::parseAtom(const string& re, size_t& pos, Fragment& fragment)
+{
+	bitset<256> set;
+	char c = re[pos++];
+	switch (c)
+	{
+	case '(':
+		if (!parseAlternation(re, pos, fragment) ||
+		    pos >= re.length() || re[pos] != ')')
+		{
+			return false;
+		}
+		pos++;
+		return true;
+	case '[':
+		if (!parseClass(re, pos, set))
+		{
+			return false;
+		}
+		break;
+	case '.':
+		set.set();
+		break;
+	case '\\':
+		if (!parseEscape(re, pos, set))
+		{
+			return false;
+		}
+		break;
+	case '*':
+	case '+':
+	case '?':
+	case '{':
+	case '^':
+	case '$':
+		// Nothing to repeat, or an anchor inside the expression
+		return false;
+	default:
+		set.set((unsigned char)c);
+		break;
+	}
+	fragment = chars(set);
+	return true;
+}
+
+/**
+ * Set the characters of an escape: "\d", "\w", "\s",
+ * their "\D", "\W", "\S" complements, or the escaped character
+ *
+ * @param    re		The regular expression
+ * @param    pos	The position after '\', updated
+ * @param    set	The character set, updated
+ * @return		False if the expression ends with '\'
+ */
+bool NameMatcher::parseEscape(const string& re, size_t& pos, bitset<256>& set)
+{
+	if (pos >= re.length())
+	{
+		return false;
+	}
+	char c = re[pos++];
+	bitset<256> escape;
+	for (unsigned int k = 0; k < 256; k++)
+	{
+		switch (tolower(c))
+		{
+		case 'd':
+			escape[k] = isdigit(k) != 0;
+			break;
+		case 'w':
+			escape[k] = isalnum(k) || k == '_';
+			break;
+		case 's':
+			escape[k] = isspace(k) != 0;
+			break;
+		default:
+			escape[k] = k == (unsigned char)c;
+			break;
+		}
+	}
+	if (c == 'D' || c == 'W' || c == 'S')
+	{
+		escape.flip();
+	}
+	set |= escape;
+	return true;
+}
+
+/**
+ * Set the characters of a class: "[abc]", "[a-z]" and "[^a-z]"
+ *
+ * @param    re		The regular expression
+ * @param    pos	The position after '[', updated
+ * @param    set	Set to the class characters
+ * @return		False for an unterminated class
+ */
+bool NameMatcher::parseClass(const string& re, size_t& pos, bitset<256>& set)
+{
+	bool negate = pos < re.length() && re[pos] == '^';
+	if (negate)
+	{
+		pos++;
+	}
+	size_t start = pos;
+	// A ']' right after '[' or '[^' is a member of the class
+	while (pos < re.length() && (re[pos] != ']' || pos == start))
+	{
+		if (re[pos] == '\\')
+		{
+			pos++;
+			if (!parseEscape(re, pos, set))
+			{
+				return false;
+			}
+			continue;
+		}
+		unsigned char from = re[pos];
+		unsigned char to = from;
+		if (pos + 2 < re.length() &&
+		    re[pos + 1] == '-' &&
+		    re[pos + 2] != ']')
+		{
+			to = re[pos + 2];
+			pos += 2;
+		}
+		for (unsigned int k = from; k <= to; k++)
+		{
+			set.set(k);
+		}
+		pos++;
+	}
+	if (pos >= re.length())
+	{
+		return false;
+	}
+	pos++;
+	if (negate)
+	{
+		set.flip();
+	}
+	return true;
+}
+
+/**
+ * Add to a set of NFA nodes the ones reached
+ * without consuming a character
+ *
+ * @param    positions	NFA nodes, sorted and closed on return
+ * @param    marks	One zero per NFA node, zero on return
+ */
+void NameMatcher::closure(vector<int>& positions, vector<char>& marks) const
+{
+	for (int p : positions)
+	{
+		marks[p] = 1;
+	}
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		const Node& node = m_nodes[positions[i]];
+		for (int e : node.epsilon)
+		{
+			if (e >= 0 && !marks[e])
+			{
+				marks[e] = 1;
+				positions.push_back(e);
+			}
+		}
+	}
+	for (int p : positions)
+	{
+		marks[p] = 0;
+	}
+	sort(positions.begin(), positions.end());
+}
+
+/**
+ * Build the DFA of all the added patterns
+ *
+ * Bytes that no pattern tells apart share the same class,
+ * so the transition table has one column per class.
+ */
+void NameMatcher::compile()
+{
+	m_next.clear();
+	m_matches.clear();
+	m_compiled = false;
+
+	// Byte classes: bytes with the same membership in all the sets
+	map<vector<bool>, unsigned char> signatures;
+	for (unsigned int c = 0; c < 256; c++)
+	{
+		vector<bool> signature;
+		signature.reserve(m_nodes.size());
+		for (auto& n : m_nodes)
+		{
+			if (n.next >= 0)
+			{
+				signature.push_back(n.chars.test(c));
+			}
+		}
+		auto it = signatures.find(signature);
+		if (it == signatures.end())
+		{
+			it = signatures.insert(make_pair(signature,
+							 (unsigned char)signatures.size())).first;
+		}
+		m_classOf[c] = (*it).second;
+	}
+	m_classes = signatures.size();
+
+	// A representative byte of each class
+	vector<unsigned char> representative(m_classes);
+	for (unsigned int c = 0; c < 256; c++)
+	{
+		representative[m_classOf[c]] = c;
+	}
+
+	// Subset construction, state 0 is the start state
+	vector<char> marks(m_nodes.size(), 0);
+	vector<int> start;
+	for (auto& p : m_patterns)
+	{
+		start.push_back(p.start);
+	}
+	closure(start, marks);
+
+	map<vector<int>, int> states;
+	vector<vector<int> > pending;
+	states.insert(make_pair(start, 0));
+	pending.push_back(start);
+
+	for (size_t s = 0; s < pending.size(); s++)
+	{
+		if (pending.size() > NAME_MATCHER_MAX_STATES)
+		{
+			// Fall back to matching patterns one by one
+			m_next.clear();
+			m_matches.clear();
+			return;
+		}
+
+		vector<int> positions = pending[s];
+		m_matches.push_back(vector<int>());
+		for (int p : positions)
+		{
+			if (m_accept[p] >= 0)
+			{
+				m_matches.back().push_back(m_patterns[m_accept[p]].id);
+			}
+		}
+
+		m_next.resize(m_next.size() + m_classes, -1);
+		for (size_t c = 0; c < m_classes; c++)
+		{
+			vector<int> next;
+			for (int p : positions)
+			{
+				const Node& n = m_nodes[p];
+				if (n.next >= 0 && n.chars.test(representative[c]))
+				{
+					next.push_back(n.next);
+				}
+			}
+			if (next.empty())
+			{
+				continue;
+			}
+			sort(next.begin(), next.end());
+			next.erase(unique(next.begin(), next.end()), next.end());
+			closure(next, marks);
+
+			auto it = states.find(next);
+			if (it == states.end())
+			{
+				it = states.insert(make_pair(next, (int)pending.size())).first;
+				pending.push_back(next);
+			}
+			m_next[s * m_classes + c] = (*it).second;
+		}
+	}
+
+	m_compiled = true;
+}
+
+/**
+ * Return the ids of the patterns matching a name
+ *
+ * @param    name	The name to match
+ * @param    length	The name length
+ * @param    matches	Caller buffer, filled with the ids
+ *			if there is no DFA
+ * @return		The matching pattern ids, in the matcher
+ *			or in the caller buffer
+ */
+const vector<int>& NameMatcher::match(const char *name,
+				      size_t length,
+				      vector<int>& matches) const
+{
+	static const vector<int> none;
+	const unsigned char *p = (const unsigned char *)name;
+
+	if (m_compiled)
+	{
+		int state = this->run(p, length);
+		return state >= 0 ? m_matches[state] : none;
+	}
+
+	matches.clear();
+	for (auto& pattern : m_patterns)
+	{
+		if (matchPattern(pattern, p, length))
+		{
+			matches.push_back(pattern.id);
+		}
+	}
+	return matches;
+}
+
+/**
+ * Check whether any pattern matches a name
+ *
+ * @param    name	The name to match
+ * @param    length	The name length
+ * @return		True if a pattern matches
+ */
+bool NameMatcher::matches(const char *name, size_t length) const
+{
+	const unsigned char *p = (const unsigned char *)name;
+
+	if (m_compiled)
+	{
+		int state = this->run(p, length);
+		return state >= 0 && !m_matches[state].empty();
+	}
+
+	for (auto& pattern : m_patterns)
+	{
+		if (matchPattern(pattern, p, length))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Run the DFA over a name
+ *
+ * @param    name	The name
+ * @param    length	The name length
+ * @return		The final DFA state, -1 if no pattern can match
+ */
+int NameMatcher::run(const unsigned char *name, size_t length) const
+{
+	int state = 0;
+	for (size_t i = 0; i < length && state >= 0; i++)
+	{
+		state = m_next[state * m_classes + m_classOf[name[i]]];
+	}
+	return state;
+}
+
+/**
+ * Match a single pattern, used when there is no DFA,
+ * following the pattern NFA nodes
+ *
+ * @param    pattern	The pattern
+ * @param    name	The name to match
+ * @param    length	The name length
+ * @return		True if the name matches
+ */
+bool NameMatcher::matchPattern(const Pattern& pattern,
+			       const unsigned char *name,
+			       size_t length) const
+{
+	static thread_local vector<char> marks;
+	static thread_local vector<int> positions;
+	static thread_local vector<int> next;
+	marks.resize(m_nodes.size(), 0);
+
+	positions.assign(1, pattern.start);
+	closure(positions, marks);
+	for (size_t i = 0; i < length && !positions.empty(); i++)
+	{
+		next.clear();
+		for (int p : positions)
+		{
+			const Node& n = m_nodes[p];
+			if (n.next >= 0 && n.chars.test(name[i]) && !marks[n.next])
+			{
+				marks[n.next] = 1;
+				next.push_back(n.next);
+			}
+		}
+		for (int p : next)
+		{
+			marks[p] = 0;
+		}
+		closure(next, marks);
+		positions.swap(next);
+	}
+	return binary_search(positions.begin(), positions.end(), pattern.accept);
+}
@@ -0,0 +1,106 @@
+/**
+ * FogLAMP OutOfBound process wide parsed payload cache
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <string.h>
+#include "payload_cache.h"
+
+using namespace std;
+
+/**
+ * Parse a notification data document
+ *
+ * @param    key	The cache key of the document
+ * @param    payload	The JSON document
+ */
+CachedPayload::CachedPayload(uint64_t key, const string& payload) :
+			     m_key(key), m_payload(payload)
+{
+	m_document.Parse(m_payload.c_str(), m_payload.length());
+}
+
+/**
+ * Return the process wide cache
+ */
+PayloadCache& PayloadCache::getInstance()
+{
+	static PayloadCache instance;
+	return instance;
+}
+
+/**
+ * Return the parsed document for the given notification data
+ *
+ * The key is a hash of the data: on a hash collision the data
+ * comparison fails and the slot is replaced. Documents are
+ * compared and parsed with no lock held.
+ *
+ * @param    payload	The JSON document
+ * @return		The cached parsed document
+ */
+shared_ptr<const CachedPayload> PayloadCache::get(const string& payload)
+{
+	uint64_t key = hash(payload.c_str(), payload.length());
+	size_t slot = key % PAYLOAD_CACHE_SLOTS;
+
+	shared_ptr<const CachedPayload> entry;
+	{
+		lock_guard<mutex> guard(m_locks[slot]);
+		entry = m_slots[slot];
+	}
+	if (entry && entry->matches(key, payload))
+	{
+		return entry;
+	}
+
+	entry = shared_ptr<const CachedPayload>(new CachedPayload(key, payload));
+	{
+		lock_guard<mutex> guard(m_locks[slot]);
+		m_slots[slot] = entry;
+	}
+
+	return entry;
+}
+
+/**
+ * 64 bit hash of the notification data, 8 bytes at a time
+ *
+ * @param    data	The data to hash
+ * @param    length	The data length
+ * @return		The hash value
+ */
+uint64_t PayloadCache::hash(const char *data, size_t length)
+{
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	uint64_t h = 0x8445d61a4e774912ULL ^ (length * m);
+
+	while (length >= 8)
+	{
+		uint64_t k;
+		memcpy(&k, data, sizeof(k));
+		k *= m;
+		k ^= k >> 47;
+		k *= m;
+		h ^= k;
+		h *= m;
+		data += 8;
+		length -= 8;
+	}
+
+	uint64_t tail = 0;
+	memcpy(&tail, data, length);
+	h ^= tail;
+	h *= m;
+
+	h ^= h >> 47;
+	h *= m;
+	h ^= h >> 47;
+
+	return h;
+}
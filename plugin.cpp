@@ -12,6 +12,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <strings.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <sys/time.h>
 #include <string>
 #include <logger.h>
 #include <plugin_exception.h>
@@ -20,8 +24,15 @@
 #include <rapidjson/writer.h>
 #include <rapidjson/stringbuffer.h>
 #include <builtin_rule.h>
+#include <chrono>
+#include <set>
 #include "version.h"
 #include "outofbound.h"
+#include "reading_ring.h"
+#include "payload_cache.h"
+#include "state_snapshot.h"
+#include "window_kernels.h"
+#include "spectrum.h"
 
 #define RULE_NAME "OutOfBound"
 #define DEFAULT_TIME_INTERVAL "30"
@@ -58,7 +69,9 @@
           "All",
           "Maximum",
           "Minimum",
-          "Average"
+          "Average",
+          "RMS",
+          "PeakToPeak"
         ],
         "type": "enumeration",
         "description": "Window data evaluation type",
@@ -101,7 +114,9 @@
 				"All",										\
 				"Maximum",									\
 				"Minimum",									\
-				"Average"									\
+				"Average",									\
+				"RMS",										\
+				"PeakToPeak"									\
 				],										\
 			"type": "enumeration",									\
 			"value": "Average",									\
@@ -140,13 +155,62 @@ static const char *default_config = QUOTE(
 			"default": RULE_CONFIG,
 			"displayName": "Configuration",
 			"order": "1"
+		},
+		"ring_buffer": {
+			"description": "Name of a shared memory ring to consume readings from, leave empty to disable",
+			"type": "string",
+			"default": "",
+			"displayName": "Ring buffer",
+			"order": "2"
+		},
+		"concurrent_eval": {
+			"description": "Allow the rule to be evaluated by several threads at the same time",
+			"type": "boolean",
+			"default": "false",
+			"displayName": "Concurrent evaluation",
+			"order": "3"
+		},
+		"payload_cache": {
+			"description": "Share parsed notification data with the other rules receiving the same data",
+			"type": "boolean",
+			"default": "false",
+			"displayName": "Shared payload cache",
+			"order": "4"
+		},
+		"persist_state": {
+			"description": "Save the rule state to a file, restored when the rule starts",
+			"type": "boolean",
+			"default": "false",
+			"displayName": "Persist state",
+			"order": "5"
+		},
+		"checkpoint_interval": {
+			"description": "Interval, in seconds, between rule state saves",
+			"type": "integer",
+			"default": "30",
+			"displayName": "Checkpoint interval",
+			"order": "6"
 		}
 	}
 );
 
 using namespace std;
 
-bool evalAsset(const Value& assetValue, RuleTrigger* rule);
+bool evalAsset(const Value& assetValue,
+	       const AssetRule& rule,
+	       double timestamp,
+	       EvalCause& cause,
+	       bool& memoised);
+double readingTimestamp(const Value& doc, const RuleSet& ruleSet);
+double readingTimestamp(const char *payload, size_t length, const RuleSet& ruleSet);
+bool validName(const string& name);
+bool configureMode(const Value& datapoint, DatapointRule& rule);
+bool qualify(bool result, const DatapointRule& rule, QualifierState& state, double timestamp);
+bool configureQualifiers(const Value& datapoint, DatapointRule& rule);
+bool configureExpression(const Value& datapoint, DatapointRule& rule);
+bool configureMagnitude(const Value& datapoint, DatapointRule& rule);
+bool configureBandEnergy(const Value& datapoint, DatapointRule& rule);
+double currentTime();
 
 /**
  * The C plugin interface
@@ -183,6 +247,8 @@ PLUGIN_HANDLE plugin_init(const ConfigCategory& config)
 	
 	OutOfBound* handle = new OutOfBound();
 	handle->configure(config);
+	// Warm restart from the last saved state
+	handle->restore();
 
 	return (PLUGIN_HANDLE)handle;
 }
@@ -193,59 +259,92 @@ PLUGIN_HANDLE plugin_init(const ConfigCategory& config)
 void plugin_shutdown(PLUGIN_HANDLE handle)
 {
 	OutOfBound* rule = (OutOfBound *)handle;
+	// Save rule state for next start
+	rule->checkpoint();
 	// Delete plugin handle
 	delete rule;
 }
 
+/**
+ * Add an asset to the triggers JSON array, once
+ *
+ * @param    writer	The triggers JSON writer
+ * @param    assets	The assets already added, updated
+ * @param    asset	The asset name
+ * @param    rule	The asset rule with the evaluation window
+ */
+void writeTrigger(Writer<StringBuffer>& writer,
+		  set<string>& assets,
+		  const string& asset,
+		  const AssetRule& rule)
+{
+	if (!assets.insert(asset).second)
+	{
+		return;
+	}
+	writer.StartObject();
+	writer.Key("asset");
+	writer.String(asset.c_str(), asset.length());
+	if (!rule.getEvaluation().empty())
+	{
+		writer.Key(rule.getEvaluation().c_str(), rule.getEvaluation().length());
+		writer.Uint(rule.getInterval());
+	}
+	writer.EndObject();
+}
+
 /**
  * Return triggers JSON document
  *
+ * The triggers are the assets of the rule program: the
+ * notification service only subscribes to asset names,
+ * so asset patterns are expanded to the "known_assets"
+ * they match.
+ *
  * @return	JSON string
  */
 string plugin_triggers(PLUGIN_HANDLE handle)
 {
-	string ret;
 	OutOfBound* rule = (OutOfBound *)handle;
+	shared_ptr<RuleProgram> program = rule->getProgram();
 
-	// Configuration fetch is protected by a lock
-	rule->lockConfig();
-
-	if (!rule->hasTriggers())
-	{
-		rule->unlockConfig();
-		ret = "{\"triggers\" : []}";
-		return ret;
-	}
-
-	ret = "{\"triggers\" : [ ";
-	std::map<std::string, RuleTrigger *> triggers = rule->getTriggers();
-	for (auto it = triggers.begin();
-		  it != triggers.end();
-		  ++it)
+	// Assets of all rule sets, each one reported once
+	set<string> assets;
+	vector<int> matches;
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+	writer.StartObject();
+	writer.Key("triggers");
+	writer.StartArray();
+	for (auto& ruleSet : program->getRuleSets())
 	{
-		ret += "{ \"asset\"  : \"" + (*it).first + "\"";
-		if (!(*it).second->getEvaluation().empty())
+		const vector<AssetRule>& rules = ruleSet.getAssets();
+		for (auto& asset : rules)
 		{
-			ret += ", \"" + (*it).second->getEvaluation() + "\" : " + \
-				to_string((*it).second->getInterval()) + " }";
+			if (!asset.isPattern())
+			{
+				writeTrigger(writer, assets, asset.getAsset(), asset);
+			}
 		}
-		else
+		if (!ruleSet.hasAssetPatterns())
 		{
-			ret += " }";
+			continue;
 		}
-		
-		if (std::next(it, 1) != triggers.end())
+		for (auto& known : program->getKnownAssets())
 		{
-			ret += ", ";
+			const vector<int>& ids = ruleSet.getAssetMatcher().match(known.c_str(),
+										 known.length(),
+										 matches);
+			if (!ids.empty())
+			{
+				writeTrigger(writer, assets, known, rules[ids.front()]);
+			}
 		}
 	}
+	writer.EndArray();
+	writer.EndObject();
 
-	ret += " ] }";
-
-	// Release lock
-	rule->unlockConfig();
-
-	return ret;
+	return string(buffer.GetString(), buffer.GetSize());
 }
 
 /**
@@ -261,55 +360,9 @@ string plugin_triggers(PLUGIN_HANDLE handle)
 bool plugin_eval(PLUGIN_HANDLE handle,
 		 const string& assetValues)
 {
-	Document doc;
-	doc.Parse(assetValues.c_str());
-	if (doc.HasParseError())
-	{
-		return false;
-	}
-
 	OutOfBound* rule = (OutOfBound *)handle;
-	map<std::string, RuleTrigger *>& triggers = rule->getTriggers();
-
-	// Iterate throgh all configured assets
-	// If we have multiple asset the evaluation result is
-	// TRUE only if all assets checks returned true
-
-	int retCount = triggers.size();
-	for (auto t = triggers.begin();
-		  t != triggers.end();
-		  ++t)
-	{
-		string assetName = (*t).first;
-		string assetTimestamp = "timestamp_" + assetName;
-		if (doc.HasMember(assetName.c_str()))
-		{
-			// Get all datapoints fir assetName
-			const Value& assetValue = doc[assetName.c_str()];
-
-			// Set evaluation
-			if (evalAsset(assetValue, (*t).second) == true)
-			{
-				retCount--;
-			}
-
-			// Add evalution timestamp
-			if (doc.HasMember(assetTimestamp.c_str()))
-			{
-				const Value& assetTime = doc[assetTimestamp.c_str()];
-				double timestamp = assetTime.GetDouble();
-				rule->setEvalTimestamp(timestamp);
-			}
-		}
-	}
-
-	// if retCount = 0, all ssets checks returned true
-	bool eval = !retCount ? true : false;
-
-	// Set final state: true is all calls to evalAsset() returned true
-	rule->setState(eval);
 
-	return eval;
+	return rule->evaluate(assetValues);
 }
 
 /**
@@ -320,20 +373,22 @@ bool plugin_eval(PLUGIN_HANDLE handle,
 string plugin_reason(PLUGIN_HANDLE handle)
 {
 	OutOfBound* rule = (OutOfBound *)handle;
-	BuiltinRule::TriggerInfo info;
-	rule->getFullState(info);
 
-	string ret = "{ \"reason\": \"";
-	ret += info.getState() == BuiltinRule::StateTriggered ? "triggered" : "cleared";
-	ret += "\"";
-	ret += ", \"asset\": " + info.getAssets();
-	if (rule->getEvalTimestamp())
-	{
-		ret += string(", \"timestamp\": \"") + info.getUTCTimestamp() + string("\"");
-	}
-	ret += " }";
+	return rule->getReason("");
+}
 
-	return ret;
+/**
+ * Update datapoint thresholds without a reconfiguration
+ *
+ * @param    patch	JSON threshold patch,
+ *			see OutOfBound::updateThresholds()
+ * @return		True if all the thresholds have been updated
+ */
+bool plugin_update_thresholds(PLUGIN_HANDLE handle, const string& patch)
+{
+	OutOfBound* rule = (OutOfBound *)handle;
+
+	return rule->updateThresholds(patch);
 }
 
 /**
@@ -354,6 +409,77 @@ void plugin_reconfigure(PLUGIN_HANDLE handle,
 // End of extern "C"
 };
 
+/**
+ * Rule set entry points
+ *
+ * These are C++ functions for a host linking the plugin,
+ * declared in outofbound.h: they are not part of the
+ * notification rule plugin interface and the notification
+ * service does not call them.
+ */
+
+/**
+ * Evaluate notification data against all the configured rule sets
+ *
+ * The data is parsed once for all the rule sets.
+ *
+ * @param    assetValues	JSON string document
+ *				with notification data.
+ * @return			The results of the "rule_sets" rule sets,
+ *				in configuration order.
+ */
+vector<bool> plugin_eval_rule_sets(PLUGIN_HANDLE handle,
+				   const string& assetValues)
+{
+	OutOfBound* rule = (OutOfBound *)handle;
+	vector<bool> results;
+
+	rule->evaluate(assetValues, &results);
+
+	return results;
+}
+
+/**
+ * Return the ids of the configured "rule_sets" rule sets
+ *
+ * @return	JSON string
+ */
+string plugin_rule_sets(PLUGIN_HANDLE handle)
+{
+	OutOfBound* rule = (OutOfBound *)handle;
+	shared_ptr<RuleProgram> program = rule->getProgram();
+	const vector<RuleSet>& ruleSets = program->getRuleSets();
+
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+	writer.StartObject();
+	writer.Key("rule_sets");
+	writer.StartArray();
+	for (auto r = ruleSets.begin() + 1;
+		  r != ruleSets.end();
+		  ++r)
+	{
+		writer.String((*r).getId().c_str(), (*r).getId().length());
+	}
+	writer.EndArray();
+	writer.EndObject();
+
+	return string(buffer.GetString(), buffer.GetSize());
+}
+
+/**
+ * Return the trigger reason of a "rule_sets" rule set
+ *
+ * @param    id		The rule set id
+ * @return		A JSON string, empty if id is not found
+ */
+string plugin_rule_set_reason(PLUGIN_HANDLE handle, const string& id)
+{
+	OutOfBound* rule = (OutOfBound *)handle;
+
+	return rule->getReason(id);
+}
+
 /**
  * Eval data against limit value
  *
@@ -407,10 +533,11 @@ bool evalData(const Value& point, double limitValue)
  *
  * @param    point		Current input datapoint
  * @param    limitValue		The DOUBLE limit value
+ * @param    value		Set to the value hitting the limit
  * @return			True if limit is hit,
  *				false otherwise
  */
-bool checkDoubleLimit(const Value& point, double limitValue)
+bool checkDoubleLimit(const Value& point, double limitValue, double& value)
 {
 	bool ret = false;
 
@@ -418,6 +545,10 @@ bool checkDoubleLimit(const Value& point, double limitValue)
 	{
 	case kNumberType:
 		ret = evalData(point, limitValue);
+		if (ret == true)
+		{
+			value = point.GetDouble();
+		}
 		break;
 
 	// This deals with window_data = All
@@ -429,6 +560,7 @@ bool checkDoubleLimit(const Value& point, double limitValue)
 			ret = evalData(*itr, limitValue);
 			if (ret == true)
 			{
+				value = (*itr).GetDouble();
 				break;
 			}
 		}
@@ -440,205 +572,3225 @@ bool checkDoubleLimit(const Value& point, double limitValue)
 }
 
 /**
- * Evaluate datapoints values for the given asset name
+ * Return the current time, for readings with no timestamp
  *
- * @param    assetValue		JSON object with datapoints
- * @param    rule		Current configured rule trigger.
+ * @return	Seconds since the epoch
+ */
+double currentTime()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/**
+ * Check a datapoint value in z-score mode
  *
- * @return			True if evalution succeded,
- *				false otherwise.
+ * The value is compared to the statistics of the previous
+ * values, then added to them.
+ *
+ * @param    value		The datapoint value
+ * @param    rule		The datapoint rule
+ * @param    stats		The running statistics
+ * @return			True if the value is more than trigger_value
+ *				standard deviations away from the mean
  */
-bool evalAsset(const Value& assetValue, RuleTrigger* rule)
+bool checkZScore(double value, const DatapointRule& rule, RunningStats& stats)
 {
-	bool assetEval = false;
+	bool ret = false;
+	if (stats.getCount() >= rule.getWarmup())
+	{
+		double stdDev = stats.getStdDev(rule.getAlpha());
+		ret = stdDev > 0 &&
+		      fabs(value - stats.getMean()) > rule.getLimit() * stdDev;
+	}
+	stats.add(value, rule.getAlpha());
+	return ret;
+}
 
-	bool evalAlldatapoints = rule->evalAllDatapoints();
-	// Check all configured datapoints for current assetName
-	vector<Datapoint *> datapoints = rule->getDatapoints();
-	for (auto it = datapoints.begin();
-		  it != datapoints.end();
-	 	 ++it)
-	{
-		string datapointName = (*it)->getName();
-		// Get input datapoint name
-		if (assetValue.HasMember(datapointName.c_str()))
-		{
-			const Value& point = assetValue[datapointName.c_str()];
-			// Check configuration datapoint type
-			switch ((*it)->getData().getType())
-			{
-			case DatapointValue::T_FLOAT:
-				assetEval = checkDoubleLimit(point,
-							   (*it)->getData().toDouble());
-				break;
-			case DatapointValue::T_STRING:
-			default:
-				break;
-				assetEval = false;
-			}
+/**
+ * Check a datapoint value in percentile mode
+ *
+ * The value is compared to the percentile of the previous
+ * values of the window, then added to them.
+ *
+ * @param    value		The datapoint value
+ * @param    rule		The datapoint rule
+ * @param    state		The datapoint rule state
+ * @param    timestamp		The reading timestamp
+ * @return			True if the value is greater than
+ *				the trigger_value percentile
+ */
+bool checkPercentile(double value,
+		     const DatapointRule& rule,
+		     DatapointState& state,
+		     double timestamp)
+{
+	if (!state.quantiles)
+	{
+		state.quantiles.reset(new QuantileWindow());
+		state.quantiles->init(rule.getWindow());
+	}
 
-			// Check eval all datapoints
-			if (assetEval == true &&
-			    evalAlldatapoints == false)
-			{
-				// At least one datapoint has been evaluated
-				break;
-			}
-		}
-		else
-		{
-			assetEval = false;
-		}
+	bool ret = false;
+	QuantileWindow& quantiles = *state.quantiles;
+	if (quantiles.getCount(timestamp) >= rule.getWarmup())
+	{
+		ret = value > quantiles.quantile(rule.getLimit() / 100, timestamp);
 	}
+	quantiles.add(value, timestamp);
+	return ret;
+}
 
-	// Return evaluation for current asset
-	return assetEval;
+/**
+ * Check a datapoint value in rate mode
+ *
+ * @param    value		The datapoint value
+ * @param    rule		The datapoint rule
+ * @param    rate		The rate of change
+ * @param    timestamp		The reading timestamp
+ * @return			True if the change per rate period,
+ *				in the rule direction, is greater
+ *				than trigger_value
+ */
+bool checkRate(double value,
+	       const DatapointRule& rule,
+	       RateOfChange& rate,
+	       double timestamp)
+{
+	if (!rate.add(value, timestamp, rule.getSmoothing()) ||
+	    rate.getCount() < 2)
+	{
+		return false;
+	}
+
+	double change = rate.getRate() * rule.getPeriod();
+	switch (rule.getDirection())
+	{
+	case RATE_FALLING:
+		return -change > rule.getLimit();
+	case RATE_BOTH:
+		return fabs(change) > rule.getLimit();
+	default:
+		return change > rule.getLimit();
+	}
 }
 
 /**
- * OutOfBound rule constructor
+ * Check a datapoint value with a stateful mode
  *
- * Call parent class BuiltinRule constructor
- * passing a plugin handle
+ * @param    value		The datapoint value
+ * @param    rule		The datapoint rule
+ * @param    state		The datapoint rule state
+ * @param    timestamp		The reading timestamp
+ * @return			True if the value triggered
  */
-OutOfBound::OutOfBound() : BuiltinRule()
+bool checkValue(double value,
+		const DatapointRule& rule,
+		DatapointState& state,
+		double timestamp)
 {
+	switch (rule.getMode())
+	{
+	case MODE_ZSCORE:
+		return checkZScore(value, rule, state.stats);
+	case MODE_PERCENTILE:
+		return checkPercentile(value, rule, state, timestamp);
+	case MODE_RATE:
+		return checkRate(value, rule, state.rate, timestamp);
+	default:
+		return false;
+	}
 }
 
 /**
- * OutOfBound destructor
+ * Apply the qualifiers of a datapoint rule to a check result
+ *
+ * "sustained_for" is applied first, then "m_of_n" counts
+ * the results of the sustained check.
+ *
+ * @param    result		The datapoint check result
+ * @param    rule		The datapoint rule
+ * @param    state		The qualifiers state
+ * @param    timestamp		The reading timestamp
+ * @return			True if the qualified check triggered
  */
-OutOfBound::~OutOfBound()
+bool qualify(bool result,
+	     const DatapointRule& rule,
+	     QualifierState& state,
+	     double timestamp)
 {
+	if (rule.getSustainedFor() > 0)
+	{
+		if (!result)
+		{
+			state.since = 0;
+			return false;
+		}
+		if (state.since == 0 || timestamp < state.since)
+		{
+			state.since = timestamp;
+		}
+		result = timestamp - state.since >= rule.getSustainedFor();
+	}
+
+	unsigned int n = rule.getSamples();
+	if (n > 0)
+	{
+		state.samples = n;
+		// Replace the oldest result in the ring
+		uint64_t& word = state.results[state.position >> 6];
+		uint64_t bit = 1ULL << (state.position & 63);
+		state.count -= (word & bit) != 0;
+		if (result)
+		{
+			word |= bit;
+			state.count++;
+		}
+		else
+		{
+			word &= ~bit;
+		}
+		state.position = state.position + 1 < n ? state.position + 1 : 0;
+		result = state.count >= rule.getMinSamples();
+	}
+
+	return result;
 }
 
 /**
- * Configure the rule plugin
+ * Check the energy of the frequency bands of a window array
  *
- * @param    config	The configuration object to process
+ * The numbers of the window are copied into a reused buffer and
+ * transformed with the shared plan of the window size.
+ *
+ * @param    point		Current input datapoint
+ * @param    rule		The datapoint rule with bands
+ * @param    state		The datapoint rule state
+ * @param    timestamp		The reading timestamp
+ * @param    value		Set to the energy of the first band
+ *				over its bound
+ * @return			True if a band energy is over its bound
  */
-void OutOfBound::configure(const ConfigCategory& config)
+bool checkBandEnergy(const Value& point,
+		     const DatapointRule& rule,
+		     DatapointState& state,
+		     double timestamp,
+		     double& value)
 {
-	string JSONrules = config.getValue("rule_config");
+	static thread_local vector<double> buffer;
+	static thread_local Spectrum spectrum;
 
-	Document doc;
-	doc.Parse(JSONrules.c_str());
+	buffer.clear();
+	if (point.IsArray())
+	{
+		for (Value::ConstValueIterator itr = point.Begin();
+		     itr != point.End();
+		     ++itr)
+		{
+			if ((*itr).IsNumber())
+			{
+				buffer.push_back((*itr).GetDouble());
+			}
+		}
+	}
 
-	if (!doc.HasParseError())
+	bool ret = false;
+	if (!buffer.empty())
 	{
-		if (doc.HasMember("rules"))
+		spectrum.compute(buffer.data(), buffer.size());
+		for (auto& band : rule.getBands())
 		{
-			// Gwt defined rules
-			const Value& rules = doc["rules"];
-			if (rules.IsArray())
+			double energy = spectrum.bandEnergy(band.low,
+							    band.high,
+							    rule.getSampleRate());
+			if (energy > band.limit)
 			{
-				// Remove current triggers
-				// Configuration change is protected by a lock
-				this->lockConfig();
-				if (this->hasTriggers())
-				{       
-					this->removeTriggers();
-				}       
-				// Release lock
-				this->unlockConfig();
-
-				/**
-				 * For each rule fetch:
-				 * asset: name,
-				 * evaluation_type: value
-				 * time_interval
-				 * datapoints array with max_allowed_value
-				 * eval_all_datapoins: check all datapoint values
-				 * or just eval the rule for at least one datapoint
-				 */
-				for (auto& rule : rules.GetArray())
-				{
-					if (!rule.HasMember("asset") && !rule.HasMember("datapoints"))
-					{
-						continue;
-					}
+				value = energy;
+				ret = true;
+				break;
+			}
+		}
+	}
 
-					const Value& asset = rule["asset"];
-					string assetName = asset["name"].GetString();
-					if (assetName.empty())
-					{
-						continue;
-					}
+	return rule.hasQualifiers() ?
+		qualify(ret, rule, state.qualifiers, timestamp) :
+		ret;
+}
 
-					bool window_evaluation = false;
-					// window_data can be empty, it means use SingleItem values
-					string window_data;
-					// time_interval might be not present only
-					// if window_data is empty
-					unsigned int timeInterval = 0;
-					if (rule.HasMember("evaluation_data"))
-					{
-						const Value& type = rule["evaluation_data"];
-						string evaluation_data = type["value"].GetString();
-						window_evaluation = evaluation_data.compare("Window") == 0;
-					}
-					if (window_evaluation && rule.HasMember("window_data"))
-					{
-						const Value& type = rule["window_data"];
-						// Set window_data value
-						window_data = type["value"].GetString();
-						if (!window_data.empty() &&
-						    rule.HasMember("time_interval"))
-						{
-							const Value& interval = rule["time_interval"];
-							timeInterval = interval.GetInt();
-						}
-						else
-						{
-							// Log message
-						}
-					}
+/**
+ * Check an input datapoint according to the datapoint rule mode
+ *
+ * Arrays (window_data = All) are checked value by value,
+ * all of them are added to the state of stateful modes.
+ *
+ * @param    point		Current input datapoint
+ * @param    rule		The datapoint rule
+ * @param    state		The datapoint rule state
+ * @param    timestamp		The reading timestamp
+ * @param    value		Set to the value which triggered
+ * @return			True if the datapoint triggered
+ */
+bool checkDatapoint(const Value& point,
+		    const DatapointRule& rule,
+		    DatapointState& state,
+		    double timestamp,
+		    double& value)
+{
+	if (rule.isBandEnergy())
+	{
+		return checkBandEnergy(point, rule, state, timestamp, value);
+	}
 
-					const Value& datapoints = rule["datapoints"];
-					bool evalAlldatapoints = true;
-					bool foundDatapoints = false;
-					if (rule.HasMember("eval_all_datapoints") &&
-					    rule["eval_all_datapoints"].IsBool())
-					{
-						evalAlldatapoints = rule["eval_all_datapoints"].GetBool();
-					}
+	bool ret = false;
+	if (rule.getMode() == MODE_LIMIT)
+	{
+		ret = checkDoubleLimit(point, rule.getLimit(), value);
+		return rule.hasQualifiers() ?
+			qualify(ret, rule, state.qualifiers, timestamp) :
+			ret;
+	}
 
-					if (datapoints.IsArray())
-					{
-						for (auto& d : datapoints.GetArray())
-						{
-							if (d.HasMember("name"))
-							{
-								foundDatapoints = true;
-
-								string dataPointName = d["name"].GetString();
-								// max_allowed_value is specific for this rule
-								if (d.HasMember("trigger_value") &&
-								    d["trigger_value"].IsNumber())
-								{
-									double maxVal = d["trigger_value"].GetDouble();
-									DatapointValue value(maxVal);
-									Datapoint* point = new Datapoint(dataPointName, value);
-									RuleTrigger* pTrigger = new RuleTrigger(dataPointName, point);
-									pTrigger->addEvaluation(window_data,
-												timeInterval,
-												evalAlldatapoints);
-									
-									// Configuration change is protected by a lock
-									this->lockConfig();
-									this->addTrigger(assetName, pTrigger);
-									// Release lock
-									this->unlockConfig();
-								}
-							}
-						}
-					}
-					if (!foundDatapoints)
-					{
-						// Log message
-					}
-				}
-			}
+	switch(point.GetType())
+	{
+	case kNumberType:
+		ret = checkValue(point.GetDouble(), rule, state, timestamp);
+		if (ret == true)
+		{
+			value = point.GetDouble();
 		}
-	}
+		break;
+
+	case kArrayType:
+		for (Value::ConstValueIterator itr = point.Begin();
+		     itr != point.End();
+		     ++itr)
+		{
+			if ((*itr).IsNumber() &&
+			    checkValue((*itr).GetDouble(), rule, state, timestamp) &&
+			    ret == false)
+			{
+				value = (*itr).GetDouble();
+				ret = true;
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return rule.hasQualifiers() ?
+		qualify(ret, rule, state.qualifiers, timestamp) :
+		ret;
+}
+
+/**
+ * Reduce window values to an aggregate
+ *
+ * NaN values, from non numeric window values, are dropped.
+ *
+ * @param    values		The window values, replaced by the
+ *				aggregate, empty if there is no value
+ * @param    aggregate		The window aggregate
+ */
+void aggregateValues(vector<double>& values, WindowAggregate aggregate)
+{
+	size_t n = 0;
+	for (double v : values)
+	{
+		if (!isnan(v))
+		{
+			values[n++] = v;
+		}
+	}
+	values.resize(n);
+	if (n == 0)
+	{
+		return;
+	}
+
+	double low, high;
+	switch (aggregate)
+	{
+	case AGGREGATE_RMS:
+		values[0] = sqrt(sumSquares(values.data(), n) / n);
+		break;
+	case AGGREGATE_PEAK_TO_PEAK:
+		minMax(values.data(), n, low, high);
+		values[0] = high - low;
+		break;
+	default:
+		return;
+	}
+	values.resize(1);
+}
+
+/**
+ * Return the window aggregate of an input datapoint
+ *
+ * The numbers of the window array are copied into a contiguous
+ * buffer, then reduced by the single pass window kernels.
+ * A number is a window of one value.
+ *
+ * @param    point		Current input datapoint
+ * @param    aggregate		The window aggregate
+ * @param    scratch		Set to the aggregate value
+ * @return			The point itself with no aggregate
+ *				or no numbers, the scratch otherwise
+ */
+const Value *aggregateWindow(const Value& point,
+			     WindowAggregate aggregate,
+			     Value& scratch)
+{
+	static thread_local vector<double> buffer;
+	if (aggregate == AGGREGATE_NONE)
+	{
+		return &point;
+	}
+
+	buffer.clear();
+	if (point.IsNumber())
+	{
+		buffer.push_back(point.GetDouble());
+	}
+	else if (point.IsArray())
+	{
+		for (Value::ConstValueIterator itr = point.Begin();
+		     itr != point.End();
+		     ++itr)
+		{
+			if ((*itr).IsNumber())
+			{
+				buffer.push_back((*itr).GetDouble());
+			}
+		}
+	}
+
+	aggregateValues(buffer, aggregate);
+	if (buffer.empty())
+	{
+		return &point;
+	}
+	scratch.SetDouble(buffer[0]);
+	return &scratch;
+}
+
+/**
+ * Evaluate an expression over the datapoints of an asset
+ *
+ * The operands must be numbers or arrays (window_data = All):
+ * with arrays the expression is evaluated element by element,
+ * up to the shortest array, number operands are repeated.
+ *
+ * @param    asset		The asset object
+ * @param    expression		The compiled expression
+ * @param    results		Set to the expression values
+ * @return			False if an operand is missing
+ *				or is not a number
+ */
+bool evalExpression(const Value& asset,
+		    const Expression& expression,
+		    vector<double>& results)
+{
+	static thread_local vector<const Value *> values;
+	static thread_local vector<double> operands;
+
+	const vector<DatapointPath>& paths = expression.getOperands();
+	values.resize(paths.size());
+	operands.resize(paths.size());
+	SizeType length = 1;
+	bool array = false;
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		values[i] = paths[i].find(asset);
+		if (!values[i])
+		{
+			return false;
+		}
+		if (values[i]->IsArray())
+		{
+			length = array ? min(length, values[i]->Size()) : values[i]->Size();
+			array = true;
+		}
+		else if (values[i]->IsNumber())
+		{
+			operands[i] = values[i]->GetDouble();
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	results.clear();
+	for (SizeType k = 0; k < length; k++)
+	{
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			if (values[i]->IsArray())
+			{
+				const Value& v = (*values[i])[k];
+				operands[i] = v.IsNumber() ? v.GetDouble() : NAN;
+			}
+		}
+		results.push_back(expression.evaluate(operands.data()));
+	}
+	return true;
+}
+
+/**
+ * Check the value of a datapoint expression according
+ * to the datapoint rule mode
+ *
+ * @param    asset		The asset object
+ * @param    rule		The datapoint rule with an expression
+ * @param    aggregate		The window aggregate of the values
+ * @param    state		The datapoint rule state
+ * @param    timestamp		The reading timestamp
+ * @param    value		Set to the value which triggered
+ * @return			True if the expression triggered
+ */
+bool checkExpression(const Value& asset,
+		     const DatapointRule& rule,
+		     WindowAggregate aggregate,
+		     DatapointState& state,
+		     double timestamp,
+		     double& value)
+{
+	static thread_local vector<double> results;
+	if (!evalExpression(asset, *rule.getExpression(), results))
+	{
+		return false;
+	}
+	if (aggregate != AGGREGATE_NONE)
+	{
+		aggregateValues(results, aggregate);
+	}
+
+	bool ret = false;
+	for (double v : results)
+	{
+		if (isnan(v))
+		{
+			continue;
+		}
+		bool hit = rule.getMode() == MODE_LIMIT ?
+				v > rule.getLimit() :
+				checkValue(v, rule, state, timestamp);
+		if (hit && ret == false)
+		{
+			value = v;
+			ret = true;
+			if (rule.getMode() == MODE_LIMIT)
+			{
+				break;
+			}
+		}
+	}
+
+	return rule.hasQualifiers() ?
+		qualify(ret, rule, state.qualifiers, timestamp) :
+		ret;
+}
+
+/**
+ * Compute the squared magnitudes of the vectors of datapoints
+ *
+ * The components must be numbers or arrays (window_data = All):
+ * arrays are copied into a contiguous buffer and their squares
+ * added by the addSquares() kernel, up to the shortest array,
+ * number components are repeated.
+ *
+ * @param    asset		The asset object
+ * @param    components		The component datapoints
+ * @param    squares		Set to the squared magnitudes
+ * @return			False if a component is missing
+ *				or is not a number
+ */
+bool squaredMagnitudes(const Value& asset,
+		       const vector<DatapointPath>& components,
+		       vector<double>& squares)
+{
+	static thread_local vector<const Value *> values;
+	static thread_local vector<double> buffer;
+
+	values.resize(components.size());
+	SizeType length = 1;
+	bool array = false;
+	double scalars = 0;
+	for (size_t i = 0; i < components.size(); i++)
+	{
+		values[i] = components[i].find(asset);
+		if (!values[i])
+		{
+			return false;
+		}
+		if (values[i]->IsArray())
+		{
+			length = array ? min(length, values[i]->Size()) : values[i]->Size();
+			array = true;
+		}
+		else if (values[i]->IsNumber())
+		{
+			double v = values[i]->GetDouble();
+			scalars += v * v;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	squares.assign(length, scalars);
+	buffer.resize(length);
+	for (size_t i = 0; array && i < components.size(); i++)
+	{
+		if (!values[i]->IsArray())
+		{
+			continue;
+		}
+		const Value& point = *values[i];
+		for (SizeType k = 0; k < length; k++)
+		{
+			buffer[k] = point[k].IsNumber() ? point[k].GetDouble() : NAN;
+		}
+		addSquares(squares.data(), buffer.data(), length);
+	}
+	return true;
+}
+
+/**
+ * Check the magnitude of the vector of the component datapoints
+ * according to the datapoint rule mode
+ *
+ * In limit mode the squared magnitudes are compared to the
+ * squared limit, with no square root.
+ *
+ * @param    asset		The asset object
+ * @param    rule		The datapoint rule with components
+ * @param    aggregate		The window aggregate of the magnitudes
+ * @param    state		The datapoint rule state
+ * @param    timestamp		The reading timestamp
+ * @param    value		Set to the magnitude which triggered
+ * @return			True if the magnitude triggered
+ */
+bool checkMagnitude(const Value& asset,
+		    const DatapointRule& rule,
+		    WindowAggregate aggregate,
+		    DatapointState& state,
+		    double timestamp,
+		    double& value)
+{
+	static thread_local vector<double> squares;
+	if (!squaredMagnitudes(asset, rule.getComponents(), squares))
+	{
+		return false;
+	}
+	if (aggregate == AGGREGATE_RMS)
+	{
+		// Root mean square of the magnitudes, squared:
+		// the mean of the squared magnitudes
+		size_t n = 0;
+		for (double s : squares)
+		{
+			if (!isnan(s))
+			{
+				squares[n++] = s;
+			}
+		}
+		squares.resize(n);
+		if (n > 0)
+		{
+			squares[0] = squaredRms(squares.data(), n);
+			squares.resize(1);
+		}
+	}
+	else if (aggregate == AGGREGATE_PEAK_TO_PEAK)
+	{
+		for (double& s : squares)
+		{
+			s = sqrt(s);
+		}
+		aggregateValues(squares, AGGREGATE_PEAK_TO_PEAK);
+		for (double& s : squares)
+		{
+			s *= s;
+		}
+	}
+
+	bool ret = false;
+	if (rule.getMode() == MODE_LIMIT)
+	{
+		// Magnitudes are never negative
+		double limit = rule.getLimit();
+		double squaredLimit = limit < 0 ? -1 : limit * limit;
+		// One scan, stopping at the first magnitude over the limit
+		for (double s : squares)
+		{
+			if (s > squaredLimit)
+			{
+				value = sqrt(s);
+				ret = true;
+				break;
+			}
+		}
+	}
+	else
+	{
+		for (double s : squares)
+		{
+			if (!isnan(s) &&
+			    checkValue(sqrt(s), rule, state, timestamp) &&
+			    ret == false)
+			{
+				value = sqrt(s);
+				ret = true;
+			}
+		}
+	}
+
+	return rule.hasQualifiers() ?
+		qualify(ret, rule, state.qualifiers, timestamp) :
+		ret;
+}
+
+/**
+ * Check a datapoint value computed from other datapoints
+ *
+ * @param    asset		The asset object
+ * @param    rule		The derived datapoint rule
+ * @param    aggregate		The window aggregate of the values
+ * @param    state		The datapoint rule state
+ * @param    timestamp		The reading timestamp
+ * @param    value		Set to the value which triggered
+ * @return			True if the value triggered
+ */
+bool checkDerived(const Value& asset,
+		  const DatapointRule& rule,
+		  WindowAggregate aggregate,
+		  DatapointState& state,
+		  double timestamp,
+		  double& value)
+{
+	return rule.isMagnitude() ?
+		checkMagnitude(asset, rule, aggregate, state, timestamp, value) :
+		checkExpression(asset, rule, aggregate, state, timestamp, value);
+}
+
+/**
+ * Return the most recent asset timestamp of a rule set
+ *
+ * @param    doc	The JSON document with notification data
+ * @param    ruleSet	The rule set
+ * @return		The timestamp, 0 if not found
+ */
+double readingTimestamp(const Value& doc, const RuleSet& ruleSet)
+{
+	double timestamp = 0;
+	if (ruleSet.hasAssetPatterns())
+	{
+		const size_t prefix = strlen("timestamp_");
+		for (Value::ConstMemberIterator m = doc.MemberBegin();
+		     m != doc.MemberEnd();
+		     ++m)
+		{
+			if (m->value.IsNumber() &&
+			    m->value.GetDouble() > timestamp &&
+			    m->name.GetStringLength() > prefix &&
+			    strncmp(m->name.GetString(), "timestamp_", prefix) == 0 &&
+			    ruleSet.getAssetMatcher().matches(m->name.GetString() + prefix,
+							      m->name.GetStringLength() - prefix))
+			{
+				timestamp = m->value.GetDouble();
+			}
+		}
+	}
+	for (auto& asset : ruleSet.getAssets())
+	{
+		if (asset.isPattern())
+		{
+			continue;
+		}
+		Value::ConstMemberIterator assetTime =
+			doc.FindMember(asset.getTimestampName().c_str());
+		if (assetTime != doc.MemberEnd() &&
+		    assetTime->value.IsNumber() &&
+		    assetTime->value.GetDouble() > timestamp)
+		{
+			timestamp = assetTime->value.GetDouble();
+		}
+	}
+	return timestamp;
+}
+
+/**
+ * Skip a JSON string of unparsed data
+ *
+ * @param    p		The opening quote
+ * @param    end	The end of the data
+ * @return		After the closing quote, NULL if unterminated
+ */
+const char *skipString(const char *p, const char *end)
+{
+	for (p++; p < end; p++)
+	{
+		if (*p == '\\')
+		{
+			p++;
+		}
+		else if (*p == '"')
+		{
+			return p + 1;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Skip a JSON value of unparsed data, with its nested
+ * objects and arrays
+ *
+ * @param    p		The value start
+ * @param    end	The end of the data
+ * @return		After the value, NULL if invalid
+ */
+const char *skipValue(const char *p, const char *end)
+{
+	int depth = 0;
+	while (p && p < end)
+	{
+		switch (*p)
+		{
+		case '"':
+			p = skipString(p, end);
+			break;
+		case '{':
+		case '[':
+			depth++;
+			p++;
+			break;
+		case '}':
+		case ']':
+			if (depth == 0)
+			{
+				return p;
+			}
+			depth--;
+			p++;
+			break;
+		case ',':
+			if (depth == 0)
+			{
+				return p;
+			}
+			p++;
+			break;
+		default:
+			p++;
+			break;
+		}
+	}
+	return depth == 0 ? p : NULL;
+}
+
+/**
+ * Return the most recent asset timestamp of a rule set,
+ * searching the unparsed notification data
+ *
+ * Only the top level members of the document are
+ * looked at: nested objects and strings are skipped.
+ *
+ * @param    payload	The NUL terminated JSON document
+ * @param    length	The document length
+ * @param    ruleSet	The rule set
+ * @return		The timestamp, 0 if not found
+ */
+double readingTimestamp(const char *payload, size_t length, const RuleSet& ruleSet)
+{
+	static const char prefix[] = "timestamp_";
+	const size_t prefixLength = sizeof(prefix) - 1;
+	double timestamp = 0;
+	const char *p = payload;
+	const char *end = payload + length;
+
+	while (p < end && isspace(*p))
+	{
+		p++;
+	}
+	if (p == end || *p != '{')
+	{
+		return 0;
+	}
+	p++;
+	while (p && p < end)
+	{
+		while (p < end && (isspace(*p) || *p == ','))
+		{
+			p++;
+		}
+		if (p == end || *p != '"')
+		{
+			break;
+		}
+		const char *name = p + 1;
+		p = skipString(p, end);
+		if (!p)
+		{
+			break;
+		}
+		size_t nameLength = p - 1 - name;
+		while (p < end && isspace(*p))
+		{
+			p++;
+		}
+		if (p == end || *p != ':')
+		{
+			break;
+		}
+		p++;
+		while (p < end && isspace(*p))
+		{
+			p++;
+		}
+
+		if (nameLength > prefixLength &&
+		    strncmp(name, prefix, prefixLength) == 0)
+		{
+			const char *asset = name + prefixLength;
+			size_t assetLength = nameLength - prefixLength;
+			if (ruleSet.hasAsset(asset, assetLength) ||
+			    (ruleSet.hasAssetPatterns() &&
+			     ruleSet.getAssetMatcher().matches(asset, assetLength)))
+			{
+				char *valueEnd;
+				double value = strtod(p, &valueEnd);
+				if (valueEnd != p && value > timestamp)
+				{
+					timestamp = value;
+				}
+			}
+		}
+		p = skipValue(p, end);
+	}
+	return timestamp;
+}
+
+/**
+ * Check an asset or datapoint name of rule_config
+ *
+ * @param    name	The name, possibly a glob pattern
+ * @return		False for an invalid pattern
+ */
+bool validName(const string& name)
+{
+	NameMatcher matcher;
+	if (NameMatcher::isPattern(name) && !matcher.add(name, 0))
+	{
+		Logger::getLogger()->error("%s: invalid name pattern '%s'",
+					   RULE_NAME, name.c_str());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Set the check mode of a datapoint rule
+ *
+ * "mode": "limit", the default, or:
+ * "zscore" with optional "alpha", the weight of the newest value
+ * for exponentially weighted statistics, and "warmup", the number
+ * of values to collect before triggering, default 10.
+ * "percentile" with optional "window", the time window
+ * in seconds, default 3600, and "warmup".
+ * "rate" with optional "rate_period", the period in seconds
+ * of the change compared to trigger_value, default 1,
+ * "smoothing", the time constant in seconds of the rate
+ * exponential smoothing, default 0, and "direction", the
+ * changes which trigger: "rising", the default, "falling" or "both".
+ *
+ * @param    datapoint	The rule_config datapoint object
+ * @param    rule	The datapoint rule to set
+ * @return		False for an invalid mode
+ */
+bool configureMode(const Value& datapoint, DatapointRule& rule)
+{
+	if (!datapoint.HasMember("mode"))
+	{
+		return true;
+	}
+	string mode = datapoint["mode"].IsString() ? datapoint["mode"].GetString() : "";
+	if (mode.compare("limit") == 0)
+	{
+		return true;
+	}
+	if (rule.isPattern())
+	{
+		Logger::getLogger()->error("%s: datapoint pattern '%s' only supports the limit mode",
+					   RULE_NAME, rule.getName().c_str());
+		return false;
+	}
+
+	if (mode.compare("percentile") == 0)
+	{
+		double window = 3600;
+		unsigned long warmup = 10;
+		if (datapoint.HasMember("window") && datapoint["window"].IsNumber())
+		{
+			window = datapoint["window"].GetDouble();
+		}
+		if (datapoint.HasMember("warmup") && datapoint["warmup"].IsUint())
+		{
+			warmup = datapoint["warmup"].GetUint();
+		}
+		if (window <= 0 || rule.getLimit() < 0 || rule.getLimit() > 100)
+		{
+			Logger::getLogger()->error("%s: datapoint '%s' needs a positive window "
+						   "and a trigger_value between 0 and 100",
+						   RULE_NAME, rule.getName().c_str());
+			return false;
+		}
+		rule.setPercentile(window, warmup);
+		return true;
+	}
+
+	if (mode.compare("rate") == 0)
+	{
+		double period = 1;
+		double smoothing = 0;
+		RateDirection direction = RATE_RISING;
+		if (datapoint.HasMember("rate_period") && datapoint["rate_period"].IsNumber())
+		{
+			period = datapoint["rate_period"].GetDouble();
+		}
+		if (datapoint.HasMember("smoothing") && datapoint["smoothing"].IsNumber())
+		{
+			smoothing = datapoint["smoothing"].GetDouble();
+		}
+		if (datapoint.HasMember("direction"))
+		{
+			string d = datapoint["direction"].IsString() ?
+					datapoint["direction"].GetString() : "";
+			if (d.compare("falling") == 0)
+			{
+				direction = RATE_FALLING;
+			}
+			else if (d.compare("both") == 0)
+			{
+				direction = RATE_BOTH;
+			}
+			else if (d.compare("rising") != 0)
+			{
+				period = 0;
+			}
+		}
+		if (period <= 0 || smoothing < 0)
+		{
+			Logger::getLogger()->error("%s: datapoint '%s' needs a positive rate_period "
+						   "and smoothing, and a rising, falling or both direction",
+						   RULE_NAME, rule.getName().c_str());
+			return false;
+		}
+		rule.setRate(period, smoothing, direction);
+		return true;
+	}
+
+	if (mode.compare("zscore") == 0)
+	{
+		double alpha = 0;
+		unsigned long warmup = 10;
+		if (datapoint.HasMember("alpha") && datapoint["alpha"].IsNumber())
+		{
+			alpha = datapoint["alpha"].GetDouble();
+		}
+		if (datapoint.HasMember("warmup") && datapoint["warmup"].IsUint())
+		{
+			warmup = datapoint["warmup"].GetUint();
+		}
+		if (alpha < 0 || alpha > 1)
+		{
+			Logger::getLogger()->error("%s: datapoint '%s' alpha must be between 0 and 1",
+						   RULE_NAME, rule.getName().c_str());
+			return false;
+		}
+		rule.setZScore(alpha, warmup);
+		return true;
+	}
+
+	Logger::getLogger()->error("%s: datapoint '%s' has an unknown mode",
+				   RULE_NAME, rule.getName().c_str());
+	return false;
+}
+
+/**
+ * Set the qualifiers of a datapoint rule check
+ *
+ * "sustained_for": seconds, the check must be true for all
+ * the readings of the given time to trigger.
+ * "m_of_n": { "m": 3, "n": 10 }, the check must be true for
+ * m of the last n readings, n up to MAX_SAMPLES.
+ *
+ * @param    datapoint	The rule_config datapoint object
+ * @param    rule	The datapoint rule to set
+ * @return		False for an invalid qualifier
+ */
+bool configureQualifiers(const Value& datapoint, DatapointRule& rule)
+{
+	if (datapoint.HasMember("sustained_for"))
+	{
+		if (!datapoint["sustained_for"].IsNumber() ||
+		    datapoint["sustained_for"].GetDouble() < 0)
+		{
+			Logger::getLogger()->error("%s: datapoint '%s' sustained_for must be "
+						   "a number of seconds",
+						   RULE_NAME, rule.getName().c_str());
+			return false;
+		}
+		rule.setSustainedFor(datapoint["sustained_for"].GetDouble());
+	}
+
+	if (datapoint.HasMember("m_of_n"))
+	{
+		const Value& mOfN = datapoint["m_of_n"];
+		if (!mOfN.IsObject() ||
+		    !mOfN.HasMember("m") || !mOfN["m"].IsUint() ||
+		    !mOfN.HasMember("n") || !mOfN["n"].IsUint() ||
+		    mOfN["m"].GetUint() == 0 ||
+		    mOfN["m"].GetUint() > mOfN["n"].GetUint() ||
+		    mOfN["n"].GetUint() > MAX_SAMPLES)
+		{
+			Logger::getLogger()->error("%s: datapoint '%s' m_of_n needs 0 < m <= n <= %d",
+						   RULE_NAME, rule.getName().c_str(), MAX_SAMPLES);
+			return false;
+		}
+		rule.setMOfN(mOfN["m"].GetUint(), mOfN["n"].GetUint());
+	}
+
+	if (rule.isPattern() && rule.hasQualifiers())
+	{
+		Logger::getLogger()->error("%s: datapoint pattern '%s' does not support qualifiers",
+					   RULE_NAME, rule.getName().c_str());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Configure the expression of a datapoint rule
+ *
+ * "expression": an arithmetic expression over datapoints of the
+ * same asset, such as "flow_in - flow_out", checked instead of
+ * the named datapoint, see Expression.
+ *
+ * @param    datapoint	The rule_config datapoint object
+ * @param    rule	The datapoint rule to set
+ * @return		False for an invalid expression
+ */
+bool configureExpression(const Value& datapoint, DatapointRule& rule)
+{
+	if (!datapoint.HasMember("expression"))
+	{
+		return true;
+	}
+	if (!datapoint["expression"].IsString())
+	{
+		Logger::getLogger()->error("%s: datapoint '%s' expression must be a string",
+					   RULE_NAME, rule.getName().c_str());
+		return false;
+	}
+
+	shared_ptr<Expression> expression(new Expression());
+	if (!expression->compile(datapoint["expression"].GetString()))
+	{
+		Logger::getLogger()->error("%s: datapoint '%s' expression '%s': %s",
+					   RULE_NAME,
+					   rule.getName().c_str(),
+					   datapoint["expression"].GetString(),
+					   expression->getError().c_str());
+		return false;
+	}
+	rule.setExpression(expression);
+	return true;
+}
+
+/**
+ * Configure the vector magnitude of a datapoint rule
+ *
+ * "magnitude": an array of datapoint names, such as
+ * [ "x", "y", "z" ], the magnitude of the vector of their
+ * values is checked instead of the named datapoint.
+ *
+ * @param    datapoint	The rule_config datapoint object
+ * @param    rule	The datapoint rule to set
+ * @return		False for invalid components
+ */
+bool configureMagnitude(const Value& datapoint, DatapointRule& rule)
+{
+	if (!datapoint.HasMember("magnitude"))
+	{
+		return true;
+	}
+
+	const Value& magnitude = datapoint["magnitude"];
+	vector<DatapointPath> components;
+	if (magnitude.IsArray())
+	{
+		for (auto& c : magnitude.GetArray())
+		{
+			if (!c.IsString() || c.GetStringLength() == 0)
+			{
+				components.clear();
+				break;
+			}
+			components.push_back(DatapointPath(c.GetString()));
+		}
+	}
+	if (components.empty() || rule.getExpression())
+	{
+		Logger::getLogger()->error("%s: datapoint '%s' magnitude must be an array "
+					   "of datapoint names, with no expression",
+					   RULE_NAME, rule.getName().c_str());
+		return false;
+	}
+	rule.setMagnitude(components);
+	return true;
+}
+
+/**
+ * Configure the band energy check of a datapoint rule
+ *
+ * "band_energy": { "sample_rate": Hz, "bands": [ ... ] }, each band
+ * with "low" and "high" frequencies and an optional "trigger_value",
+ * the datapoint one if missing. The window array of the datapoint
+ * triggers if the energy of a band is greater than its bound.
+ *
+ * @param    datapoint	The rule_config datapoint object
+ * @param    rule	The datapoint rule to set
+ * @return		False for invalid bands
+ */
+bool configureBandEnergy(const Value& datapoint, DatapointRule& rule)
+{
+	if (!datapoint.HasMember("band_energy"))
+	{
+		return true;
+	}
+
+	const Value& spectrum = datapoint["band_energy"];
+	double sampleRate = 0;
+	vector<EnergyBand> bands;
+	if (spectrum.IsObject() &&
+	    spectrum.HasMember("sample_rate") &&
+	    spectrum["sample_rate"].IsNumber() &&
+	    spectrum.HasMember("bands") &&
+	    spectrum["bands"].IsArray())
+	{
+		sampleRate = spectrum["sample_rate"].GetDouble();
+		for (auto& b : spectrum["bands"].GetArray())
+		{
+			if (!b.IsObject() ||
+			    !b.HasMember("low") || !b["low"].IsNumber() ||
+			    !b.HasMember("high") || !b["high"].IsNumber() ||
+			    b["low"].GetDouble() < 0 ||
+			    b["high"].GetDouble() <= b["low"].GetDouble() ||
+			    (b.HasMember("trigger_value") && !b["trigger_value"].IsNumber()))
+			{
+				bands.clear();
+				break;
+			}
+			EnergyBand band;
+			band.low = b["low"].GetDouble();
+			band.high = b["high"].GetDouble();
+			band.limit = b.HasMember("trigger_value") ?
+					b["trigger_value"].GetDouble() :
+					rule.getLimit();
+			bands.push_back(band);
+		}
+	}
+	if (sampleRate <= 0 || bands.empty())
+	{
+		Logger::getLogger()->error("%s: datapoint '%s' band_energy needs a sample_rate "
+					   "and bands with 0 <= low < high",
+					   RULE_NAME, rule.getName().c_str());
+		return false;
+	}
+	if (rule.isPattern() || rule.isDerived() || rule.getMode() != MODE_LIMIT)
+	{
+		Logger::getLogger()->error("%s: datapoint '%s' band_energy only supports "
+					   "datapoint names in the limit mode",
+					   RULE_NAME, rule.getName().c_str());
+		return false;
+	}
+	rule.setBandEnergy(sampleRate, bands);
+	return true;
+}
+
+/**
+ * Add an input datapoint value to the values compared
+ * by the unchanged value memoization
+ *
+ * @param    values		The memoised values, updated
+ * @param    point		Current input datapoint, NULL if missing
+ * @return			False for an array value, which is
+ *				not memoised
+ */
+bool addMemoValue(vector<MemoValue>& values, const Value *point)
+{
+	MemoValue memo;
+	memo.value = 0;
+	if (!point)
+	{
+		memo.kind = MemoValue::MISSING;
+	}
+	else if (point->IsNumber())
+	{
+		memo.kind = MemoValue::NUMBER;
+		memo.value = point->GetDouble();
+	}
+	// This deals with window_data = All
+	else if (point->IsArray())
+	{
+		return false;
+	}
+	else
+	{
+		memo.kind = MemoValue::OTHER;
+	}
+	values.push_back(memo);
+	return true;
+}
+
+/**
+ * Evaluate datapoints values for the given asset name
+ *
+ * If all the datapoint values are scalars and the same of the
+ * previous evaluation the previous result is returned.
+ *
+ * The asset state is locked for the whole evaluation only if
+ * the checks update it, otherwise only to use the memoised result.
+ *
+ * A datapoint pattern hits the limit if any of the matching
+ * datapoints does: the asset datapoints are matched once against
+ * all the patterns. Results of assets with datapoint patterns
+ * are not memoised.
+ *
+ * @param    assetValue		JSON object with datapoints
+ * @param    rule		Current compiled asset rule.
+ * @param    timestamp		The reading timestamp
+ * @param    cause		Set to the datapoint and value
+ *				which triggered
+ * @param    memoised		Set to true if the memoised
+ *				result is returned
+ *
+ * @return			True if evalution succeded,
+ *				false otherwise.
+ */
+bool evalAsset(const Value& assetValue,
+	       const AssetRule& rule,
+	       double timestamp,
+	       EvalCause& cause,
+	       bool& memoised)
+{
+	bool assetEval = false;
+	memoised = false;
+
+	AssetState& state = rule.getState();
+
+	bool evalAlldatapoints = rule.evalAllDatapoints();
+	WindowAggregate aggregate = rule.getAggregate();
+	const vector<DatapointRule>& datapoints = rule.getDatapoints();
+
+	// Get input datapoints and the values to compare
+	static thread_local vector<const Value *> points;
+	static thread_local vector<MemoValue> values;
+	points.resize(datapoints.size());
+	values.clear();
+	bool patterns = rule.hasDatapointPatterns();
+	bool memo = !patterns && !rule.isStateful();
+	for (size_t i = 0; i < datapoints.size(); i++)
+	{
+		if (datapoints[i].isPattern())
+		{
+			points[i] = NULL;
+			continue;
+		}
+		if (datapoints[i].isDerived())
+		{
+			// Operands are looked up by checkDerived()
+			points[i] = NULL;
+			for (auto& operand : datapoints[i].getOperands())
+			{
+				memo = memo && addMemoValue(values, operand.find(assetValue));
+			}
+		}
+		else
+		{
+			points[i] = datapoints[i].find(assetValue);
+			memo = memo && addMemoValue(values, points[i]);
+		}
+	}
+
+	if (memo)
+	{
+		int index;
+		double value;
+		bool unchanged;
+		{
+			lock_guard<mutex> guard(state.getMutex());
+			unchanged = state.findMemo(rule.getRevision(),
+						   values, assetEval, index, value);
+		}
+		if (unchanged)
+		{
+			if (assetEval == true && index >= 0)
+			{
+				cause.datapoint = &datapoints[index];
+				cause.value = value;
+			}
+			memoised = true;
+			return assetEval;
+		}
+	}
+
+	// Datapoint patterns: first matching datapoint hitting the limit
+	static thread_local vector<char> matched;
+	static thread_local vector<const Value *> matchedName;
+	static thread_local vector<double> matchedValue;
+	static thread_local vector<int> matches;
+	if (patterns)
+	{
+		matched.assign(datapoints.size(), 0);
+		matchedName.resize(datapoints.size());
+		matchedValue.resize(datapoints.size());
+		const NameMatcher& matcher = rule.getDatapointMatcher();
+		Value scratch;
+		for (Value::ConstMemberIterator m = assetValue.MemberBegin();
+		     m != assetValue.MemberEnd();
+		     ++m)
+		{
+			const vector<int>& ids = matcher.match(m->name.GetString(),
+							       m->name.GetStringLength(),
+							       matches);
+			for (int id : ids)
+			{
+				if (!matched[id] &&
+				    checkDoubleLimit(*aggregateWindow(m->value,
+								      aggregate,
+								      scratch),
+						     datapoints[id].getLimit(),
+						     matchedValue[id]))
+				{
+					matched[id] = 1;
+					matchedName[id] = &m->name;
+				}
+			}
+		}
+	}
+
+	// Stateful checks update the datapoint states
+	unique_lock<mutex> guard(state.getMutex(), defer_lock);
+	if (rule.isStateful())
+	{
+		guard.lock();
+	}
+
+	// Check all configured datapoints for current assetName
+	// Checks of stateless rules do not use the states
+	static thread_local vector<DatapointState> unused;
+	vector<DatapointState>& states = rule.isStateful() ?
+					 state.getDatapointStates() :
+					 unused;
+	states.resize(datapoints.size());
+	int causeIndex = -1;
+	size_t i;
+	for (i = 0; i < datapoints.size(); i++)
+	{
+		if (datapoints[i].isPattern())
+		{
+			assetEval = matched[i] != 0;
+			if (assetEval == true)
+			{
+				cause.datapoint = &datapoints[i];
+				cause.datapointName = matchedName[i]->GetString();
+				cause.value = matchedValue[i];
+			}
+
+			// Check eval all datapoints
+			if (assetEval == true &&
+			    evalAlldatapoints == false)
+			{
+				break;
+			}
+		}
+		else if (points[i] || datapoints[i].isDerived())
+		{
+			Value scratch;
+			assetEval = points[i] ?
+				checkDatapoint(*aggregateWindow(*points[i],
+								aggregate,
+								scratch),
+					       datapoints[i],
+					       states[i],
+					       timestamp,
+					       cause.value) :
+				checkDerived(assetValue,
+					     datapoints[i],
+					     aggregate,
+					     states[i],
+					     timestamp,
+					     cause.value);
+			if (assetEval == true)
+			{
+				cause.datapoint = &datapoints[i];
+				cause.datapointName = NULL;
+				causeIndex = i;
+			}
+
+			// Check eval all datapoints
+			if (assetEval == true &&
+			    evalAlldatapoints == false)
+			{
+				// At least one datapoint has been evaluated
+				break;
+			}
+		}
+		else
+		{
+			assetEval = false;
+		}
+	}
+
+	// Datapoints not checked still add their value to their state
+	if (rule.isStateful())
+	{
+		double ignored;
+		for (i++; i < datapoints.size(); i++)
+		{
+			if (!datapoints[i].isStateful())
+			{
+				continue;
+			}
+			if (points[i])
+			{
+				Value scratch;
+				checkDatapoint(*aggregateWindow(*points[i],
+								aggregate,
+								scratch),
+					       datapoints[i],
+					       states[i],
+					       timestamp,
+					       ignored);
+			}
+			else if (datapoints[i].isDerived())
+			{
+				checkDerived(assetValue,
+					     datapoints[i],
+					     aggregate,
+					     states[i],
+					     timestamp,
+					     ignored);
+			}
+		}
+	}
+
+	if (memo)
+	{
+		lock_guard<mutex> memoGuard(state.getMutex());
+		state.setMemo(rule.getRevision(),
+			      values, assetEval, causeIndex, cause.value);
+	}
+
+	// Return evaluation for current asset
+	return assetEval;
+}
+
+/**
+ * OutOfBound rule constructor
+ *
+ * Call parent class BuiltinRule constructor
+ * passing a plugin handle
+ */
+OutOfBound::OutOfBound() : BuiltinRule(),
+			   m_program(new RuleProgram()),
+			   m_primaryState(new RuleSetState(this)),
+			   m_concurrent(false),
+			   m_payloadCache(false),
+			   m_checkpointInterval(0),
+			   m_checkpointThread(NULL),
+			   m_checkpointRunning(false),
+			   m_ringThread(NULL),
+			   m_ringRunning(false)
+{
+	m_program->addRuleSet("", m_primaryState);
+}
+
+/**
+ * OutOfBound destructor
+ */
+OutOfBound::~OutOfBound()
+{
+	stopCheckpoints();
+	stopRing();
+}
+
+/**
+ * Parse and evaluate notification data
+ *
+ * @param    assetValues	JSON string document
+ *				with notification data.
+ * @param    results		If not NULL, set to the results
+ *				of the "rule_sets" rule sets
+ * @return			True if the rule was triggered,
+ *				false otherwise.
+ */
+bool OutOfBound::evaluate(const string& assetValues, vector<bool> *results)
+{
+	// Not evaluated together with the ring consumer,
+	// unless concurrent evaluation is enabled
+	unique_lock<mutex> evalLock(m_evalMutex, defer_lock);
+	if (!m_concurrent)
+	{
+		evalLock.lock();
+	}
+	bool eval = false;
+	if (this->evalHeld(assetValues.c_str(), assetValues.length(), results, eval))
+	{
+		// All rule sets in hold-off, no parsing needed
+		return eval;
+	}
+
+	if (m_payloadCache)
+	{
+		// Parsed once for all the rule instances
+		shared_ptr<const CachedPayload> payload =
+				PayloadCache::getInstance().get(assetValues);
+		if (payload->isValid())
+		{
+			return this->evaluate(payload->getDocument(), results);
+		}
+		if (results)
+		{
+			results->clear();
+		}
+		return false;
+	}
+
+	ParseScratch& scratch = this->getScratch();
+
+	{
+		ScratchDocument doc(scratch.getValueAllocator(),
+				    1024,
+				    scratch.getStackAllocator());
+		doc.Parse(assetValues.c_str(), assetValues.length());
+		if (!doc.HasParseError())
+		{
+			eval = this->evaluate(doc, results);
+		}
+		else if (results)
+		{
+			results->clear();
+		}
+	}
+
+	// Release parse memory for next call
+	scratch.clear();
+
+	return eval;
+}
+
+/**
+ * Evaluate a parsed notification data document
+ *
+ * The document is parsed once and all the rule sets
+ * are evaluated against it.
+ * The compiled rule program is not changed by evaluations,
+ * only the final state merges are serialised.
+ *
+ * @param    doc	The JSON document with notification data
+ * @param    results	If not NULL, set to the results
+ *			of the "rule_sets" rule sets
+ * @return		The "rules" rule set result or, if no "rules"
+ *			are configured, true if any rule set triggered.
+ */
+bool OutOfBound::evaluate(const Value& doc, vector<bool> *results)
+{
+	// Keep a reference: a reconfiguration might replace the program
+	shared_ptr<RuleProgram> program = this->getProgram();
+	const vector<RuleSet>& ruleSets = program->getRuleSets();
+
+	static thread_local vector<char> evals;
+	evals.resize(ruleSets.size());
+	// With no "rules" the primary state is set by ruleResult()
+	for (size_t i = program->isAnyRuleSet() ? 1 : 0; i < ruleSets.size(); i++)
+	{
+		evals[i] = this->updateRuleSet(doc, ruleSets[i]);
+	}
+
+	return this->ruleResult(*program, evals, results);
+}
+
+/**
+ * Evaluate a rule set and merge its state,
+ * unless the reading is in its hold-off period
+ *
+ * @param    doc	The JSON document with notification data
+ * @param    ruleSet	The rule set
+ * @return		The rule set state
+ */
+bool OutOfBound::updateRuleSet(const Value& doc, const RuleSet& ruleSet)
+{
+	bool eval = false;
+	if (ruleSet.getHoldOff() > 0 &&
+	    this->isHeld(ruleSet, readingTimestamp(doc, ruleSet), eval))
+	{
+		// In hold-off: state not changed
+		return eval;
+	}
+
+	double timestamp = 0;
+	EvalCause cause = { NULL, NULL, 0, NULL, NULL };
+	bool memoised;
+	eval = this->evalRuleSet(doc, ruleSet, timestamp, cause, memoised);
+	return this->mergeState(ruleSet, eval, timestamp, cause, memoised);
+}
+
+/**
+ * Return the rule result from the rule set states
+ *
+ * If no "rules" are configured the result, with the cause and
+ * timestamp of the first triggered rule set, is kept in the
+ * primary state, so that plugin_reason matches plugin_eval.
+ *
+ * @param    program	The rule program
+ * @param    evals	The rule set states, in rule set order
+ * @param    results	If not NULL, set to the states
+ *			of the "rule_sets" rule sets
+ * @return		The "rules" rule set state or, if no "rules"
+ *			are configured, true if any rule set triggered.
+ */
+bool OutOfBound::ruleResult(const RuleProgram& program,
+			    const vector<char>& evals,
+			    vector<bool> *results)
+{
+	const vector<RuleSet>& ruleSets = program.getRuleSets();
+	if (results)
+	{
+		results->clear();
+	}
+	bool any = false;
+	for (size_t i = 1; i < ruleSets.size(); i++)
+	{
+		any = any || evals[i];
+		if (results)
+		{
+			results->push_back(evals[i]);
+		}
+	}
+
+	if (!program.isAnyRuleSet())
+	{
+		return evals[0];
+	}
+
+	const RuleSet *triggered = NULL;
+	for (size_t i = 1; i < ruleSets.size() && !triggered; i++)
+	{
+		if (evals[i])
+		{
+			triggered = &ruleSets[i];
+		}
+	}
+	TriggerCause cause = TriggerCause();
+	double timestamp = 0;
+	if (triggered)
+	{
+		RuleSetState& state = *triggered->getState();
+		lock_guard<mutex> guard(state.getMutex());
+		cause = state.getCause();
+		timestamp = state.getTimestamp();
+	}
+
+	RuleSetState& state = *ruleSets.front().getState();
+	lock_guard<mutex> guard(state.getMutex());
+	BuiltinRule *rule = state.getRule();
+	if (triggered)
+	{
+		state.setCause(cause);
+	}
+	if (timestamp)
+	{
+		rule->setEvalTimestamp(timestamp);
+		state.setTimestamp(timestamp);
+	}
+	rule->setState(any);
+	state.setTriggered(any);
+
+	return any;
+}
+
+/**
+ * Return the rule state without parsing the notification data
+ * if all the rule sets are in their hold-off period.
+ *
+ * Only the asset timestamps are looked for in the data.
+ * Rule sets with no asset rules need no data: they are
+ * evaluated as usual.
+ *
+ * @param    payload	The JSON document with notification data
+ * @param    length	The document length
+ * @param    results	If not NULL, set to the results
+ *			of the "rule_sets" rule sets
+ * @param    eval	Set to the rule state
+ * @return		True if all rule sets are in hold-off,
+ *			false if the data must be evaluated.
+ */
+bool OutOfBound::evalHeld(const char *payload,
+			  size_t length,
+			  vector<bool> *results,
+			  bool& eval)
+{
+	shared_ptr<RuleProgram> program = this->getProgram();
+	const vector<RuleSet>& ruleSets = program->getRuleSets();
+
+	for (auto r = ruleSets.begin();
+		  r != ruleSets.end();
+		  ++r)
+	{
+		if ((*r).getAssets().empty())
+		{
+			continue;
+		}
+		if ((*r).getHoldOff() <= 0)
+		{
+			return false;
+		}
+		// No hold-off period started yet: nothing to scan the data for
+		RuleSetState& state = *(*r).getState();
+		lock_guard<mutex> guard(state.getMutex());
+		if (state.getHoldUntil() <= 0)
+		{
+			return false;
+		}
+	}
+
+	static thread_local vector<char> held;
+	held.resize(ruleSets.size());
+	for (size_t i = 0; i < ruleSets.size(); i++)
+	{
+		bool result = false;
+		if (!ruleSets[i].getAssets().empty() &&
+		    !this->isHeld(ruleSets[i],
+				  readingTimestamp(payload, length, ruleSets[i]),
+				  result))
+		{
+			return false;
+		}
+		held[i] = result;
+	}
+
+	static const Value none(kObjectType);
+	for (size_t i = program->isAnyRuleSet() ? 1 : 0; i < ruleSets.size(); i++)
+	{
+		if (ruleSets[i].getAssets().empty())
+		{
+			held[i] = this->updateRuleSet(none, ruleSets[i]);
+		}
+	}
+
+	eval = this->ruleResult(*program, held, results);
+
+	return true;
+}
+
+/**
+ * Check whether a rule set is in its hold-off period
+ *
+ * @param    ruleSet	The rule set
+ * @param    timestamp	The reading timestamp
+ * @param    eval	Set to the held rule set result
+ * @return		True if the reading is in the hold-off period
+ */
+bool OutOfBound::isHeld(const RuleSet& ruleSet, double timestamp, bool& eval)
+{
+	RuleSetState& state = *ruleSet.getState();
+	lock_guard<mutex> guard(state.getMutex());
+
+	if (timestamp > 0 && timestamp < state.getHoldUntil())
+	{
+		eval = ruleSet.isEdgeTriggered() ? false : state.isTriggered();
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Evaluate a rule set against notification data
+ *
+ *  Note: all assets must trigger in order to return TRUE
+ *
+ * With a latest value max age, an asset missing from the data
+ * counts with its latest result if it is not older than the
+ * max age, so assets need not arrive together.
+ *
+ * @param    doc	The JSON document with notification data
+ * @param    ruleSet	The rule set to evaluate
+ * @param    timestamp	Set to the most recent reading timestamp
+ * @param    cause	Set to the first datapoint which triggered
+ * @param    memoised	Set to true if all the asset results
+ *			are the memoised ones
+ * @return		True if the rule set was triggered,
+ *			false otherwise.
+ */
+bool OutOfBound::evalRuleSet(const Value& doc,
+			     const RuleSet& ruleSet,
+			     double& timestamp,
+			     EvalCause& cause,
+			     bool& memoised)
+{
+	const vector<AssetRule>& assets = ruleSet.getAssets();
+	memoised = !assets.empty() && !ruleSet.hasAssetPatterns();
+
+	// Iterate throgh all configured assets
+	// If we have multiple asset the evaluation result is
+	// TRUE only if all assets checks returned true
+
+	// Assets missing from the data, for the latest values
+	static thread_local vector<const AssetRule *> missing;
+	double maxAge = ruleSet.getMaxAge();
+	missing.clear();
+
+	int retCount = assets.size();
+	for (auto t = assets.begin();
+		  t != assets.end();
+		  ++t)
+	{
+		if ((*t).isPattern())
+		{
+			continue;
+		}
+		Value::ConstMemberIterator asset = doc.FindMember((*t).getAsset().c_str());
+		if (asset == doc.MemberEnd())
+		{
+			memoised = false;
+			if (maxAge > 0)
+			{
+				missing.push_back(&(*t));
+			}
+		}
+		else
+		{
+			// Get evalution timestamp
+			double assetTimestamp = 0;
+			Value::ConstMemberIterator assetTime =
+				doc.FindMember((*t).getTimestampName().c_str());
+			if (assetTime != doc.MemberEnd() &&
+			    assetTime->value.IsNumber())
+			{
+				assetTimestamp = assetTime->value.GetDouble();
+				if (assetTimestamp > timestamp)
+				{
+					timestamp = assetTimestamp;
+				}
+			}
+
+			// Set evaluation
+			EvalCause assetCause = { &(*t), NULL, 0, NULL, NULL };
+			// Only stateful checks need the time of a reading without timestamp
+			double evalTimestamp = assetTimestamp || !(*t).isStateful() ?
+						assetTimestamp :
+						currentTime();
+			bool assetMemoised;
+			bool assetEval = evalAsset(asset->value,
+						   *t,
+						   evalTimestamp,
+						   assetCause,
+						   assetMemoised);
+			memoised = memoised && assetMemoised;
+			if (assetEval == true)
+			{
+				retCount--;
+				if (!cause.asset)
+				{
+					cause = assetCause;
+				}
+			}
+
+			// Only results with a reading timestamp are kept:
+			// the time of evaluation is not the time of the reading
+			if (maxAge > 0 && assetTimestamp > 0)
+			{
+				AssetState& state = (*t).getState();
+				lock_guard<mutex> guard(state.getMutex());
+				state.setLatest(assetEval,
+						assetTimestamp,
+						assetCause.datapoint ?
+							assetCause.datapoint - &(*t).getDatapoints()[0] :
+							-1,
+						assetCause.value);
+			}
+		}
+	}
+
+	// Missing assets count with their latest result, if recent enough
+	if (!missing.empty())
+	{
+		double since = (timestamp ? timestamp : currentTime()) - maxAge;
+		for (const AssetRule *t : missing)
+		{
+			int index;
+			double value;
+			AssetState& state = t->getState();
+			lock_guard<mutex> guard(state.getMutex());
+			if (state.isLatestTriggered(since, index, value))
+			{
+				retCount--;
+				if (!cause.asset && index >= 0)
+				{
+					EvalCause latestCause = { t, &t->getDatapoints()[index], value, NULL, NULL };
+					cause = latestCause;
+				}
+			}
+		}
+	}
+
+	if (ruleSet.hasAssetPatterns())
+	{
+		retCount -= evalAssetPatterns(doc, ruleSet, timestamp, cause);
+	}
+
+	// if retCount = 0, all ssets checks returned true,
+	// a rule set with no asset rules is never triggered
+	return !assets.empty() && !retCount ? true : false;
+}
+
+/**
+ * Evaluate the asset patterns of a rule set
+ *
+ * Each asset in the notification data is matched once against
+ * all the patterns: a pattern is triggered if any of the
+ * matching assets is.
+ *
+ * @param    doc	The JSON document with notification data
+ * @param    ruleSet	The rule set to evaluate
+ * @param    timestamp	Set to the most recent reading timestamp
+ * @param    cause	Set to the first datapoint which triggered
+ * @return		The number of triggered patterns
+ */
+int OutOfBound::evalAssetPatterns(const Value& doc,
+				  const RuleSet& ruleSet,
+				  double& timestamp,
+				  EvalCause& cause)
+{
+	const vector<AssetRule>& assets = ruleSet.getAssets();
+	const NameMatcher& matcher = ruleSet.getAssetMatcher();
+
+	static thread_local vector<char> triggered;
+	static thread_local string timestampName;
+	// Not the buffer of the datapoint patterns matched in evalAsset()
+	static thread_local vector<int> matches;
+	triggered.assign(assets.size(), 0);
+
+	int count = 0;
+	for (Value::ConstMemberIterator asset = doc.MemberBegin();
+	     asset != doc.MemberEnd();
+	     ++asset)
+	{
+		if (!asset->value.IsObject())
+		{
+			// Reading timestamps
+			continue;
+		}
+		const vector<int>& ids = matcher.match(asset->name.GetString(),
+						       asset->name.GetStringLength(),
+						       matches);
+		if (ids.empty())
+		{
+			continue;
+		}
+
+		// Get evalution timestamp
+		double assetTimestamp = 0;
+		timestampName.assign("timestamp_");
+		timestampName.append(asset->name.GetString(), asset->name.GetStringLength());
+		Value::ConstMemberIterator assetTime = doc.FindMember(timestampName.c_str());
+		if (assetTime != doc.MemberEnd() &&
+		    assetTime->value.IsNumber())
+		{
+			assetTimestamp = assetTime->value.GetDouble();
+			if (assetTimestamp > timestamp)
+			{
+				timestamp = assetTimestamp;
+			}
+		}
+
+		for (int id : ids)
+		{
+			if (triggered[id])
+			{
+				continue;
+			}
+			EvalCause assetCause = { &assets[id], NULL, 0, asset->name.GetString(), NULL };
+			bool memoised;
+			if (evalAsset(asset->value,
+				      assets[id],
+				      assetTimestamp || !assets[id].isStateful() ?
+					assetTimestamp :
+					currentTime(),
+				      assetCause,
+				      memoised) == true)
+			{
+				triggered[id] = 1;
+				count++;
+				if (!cause.asset)
+				{
+					cause = assetCause;
+				}
+			}
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Set rule set state after an evaluation
+ *
+ * In concurrent mode evaluations might complete out of order:
+ * the state of a reading older than the current one is discarded
+ * and the current state returned instead. Readings without
+ * timestamp are not ordered: their state is always kept.
+ *
+ * Edge triggered rule sets return true only when the state
+ * goes from cleared to triggered.
+ *
+ * @param    ruleSet	The rule set
+ * @param    eval	The evaluation result
+ * @param    timestamp	The reading timestamp, 0 if not available
+ * @param    cause	The datapoint which triggered
+ * @param    memoised	True if the result is made of memoised results
+ * @return		The rule set state
+ */
+bool OutOfBound::mergeState(const RuleSet& ruleSet,
+			    bool eval,
+			    double timestamp,
+			    const EvalCause& cause,
+			    bool memoised)
+{
+	RuleSetState& state = *ruleSet.getState();
+	lock_guard<mutex> guard(state.getMutex());
+	BuiltinRule *rule = state.getRule();
+
+	if (m_concurrent && timestamp > 0 && timestamp < state.getTimestamp())
+	{
+		return ruleSet.isEdgeTriggered() ? false : state.isTriggered();
+	}
+
+	// Memoised result, the same as the state: the cause is kept
+	// and only the evaluation time changes, unless a hold-off
+	// period starts
+	if (memoised &&
+	    eval == state.isTriggered() &&
+	    !(eval && ruleSet.getHoldOff() > 0))
+	{
+		if (timestamp)
+		{
+			rule->setEvalTimestamp(timestamp);
+			state.setTimestamp(timestamp);
+		}
+		// Edge triggered: already reported, or already rearmed
+		return ruleSet.isEdgeTriggered() ? false : eval;
+	}
+
+	// Keep what triggered for the reason
+	if (eval && cause.datapoint)
+	{
+		state.setCause(cause, ruleSet.getProgram());
+	}
+
+	// Add evalution timestamp
+	if (timestamp)
+	{
+		rule->setEvalTimestamp(timestamp);
+		state.setTimestamp(timestamp);
+	}
+
+	// Set final state: true is all calls to evalAsset() returned true
+	rule->setState(eval);
+	state.setTriggered(eval);
+
+	// Start the hold-off period
+	if (eval &&
+	    ruleSet.getHoldOff() > 0 &&
+	    timestamp >= state.getHoldUntil())
+	{
+		state.setHoldUntil(timestamp + ruleSet.getHoldOff());
+	}
+
+	if (ruleSet.isEdgeTriggered())
+	{
+		if (!eval)
+		{
+			if (ruleSet.rearmAfterClear())
+			{
+				state.setArmed(true);
+			}
+			return false;
+		}
+		if (!state.isArmed())
+		{
+			return false;
+		}
+		state.setArmed(false);
+	}
+
+	return eval;
+}
+
+/**
+ * Return the trigger reason of a rule set
+ *
+ * The reason is built from the state kept by the evaluations
+ * only when requested, reusing the same JSON writer.
+ *
+ * @param    ruleSetId	The rule set id, empty for the "rules" one
+ * @return		A JSON string, empty if the id is not found
+ */
+string OutOfBound::getReason(const string& ruleSetId)
+{
+	shared_ptr<RuleProgram> program = this->getProgram();
+	const RuleSet *ruleSet = program->findRuleSet(ruleSetId);
+	if (!ruleSet)
+	{
+		return "";
+	}
+
+	// The reason writer is protected by the config lock,
+	// the state fetch by the state lock
+	lock_guard<mutex> guard(m_configMutex);
+	RuleSetState *state = ruleSet->getState();
+	lock_guard<mutex> stateGuard(state->getMutex());
+	bool triggered = state->isTriggered();
+
+	m_reasonBuffer.Clear();
+	m_reasonWriter.Reset(m_reasonBuffer);
+
+	m_reasonWriter.StartObject();
+	m_reasonWriter.Key("reason");
+	m_reasonWriter.String(triggered ? "triggered" : "cleared");
+	if (!ruleSetId.empty())
+	{
+		m_reasonWriter.Key("rule_set");
+		m_reasonWriter.String(ruleSetId.c_str(), ruleSetId.length());
+	}
+	m_reasonWriter.Key("asset");
+	m_reasonWriter.StartArray();
+	if (ruleSetId.empty() && program->isAnyRuleSet())
+	{
+		// The result of any rule set: the assets of all of them
+		set<string> assets;
+		for (auto& r : program->getRuleSets())
+		{
+			for (auto& asset : r.getAssets())
+			{
+				if (assets.insert(asset.getAsset()).second)
+				{
+					m_reasonWriter.String(asset.getAsset().c_str(),
+							      asset.getAsset().length());
+				}
+			}
+		}
+	}
+	else
+	{
+		for (auto& asset : ruleSet->getAssets())
+		{
+			m_reasonWriter.String(asset.getAsset().c_str(), asset.getAsset().length());
+		}
+	}
+	m_reasonWriter.EndArray();
+	if (state->getTimestamp())
+	{
+		m_reasonWriter.Key("timestamp");
+		m_reasonWriter.String(m_timestampFormatter.format(state->getTimestamp()));
+	}
+	const TriggerCause& cause = state->getCause();
+	if (triggered && cause.valid)
+	{
+		m_reasonWriter.Key("cause");
+		m_reasonWriter.StartObject();
+		m_reasonWriter.Key("asset");
+		m_reasonWriter.String(cause.getAsset().c_str(), cause.getAsset().length());
+		m_reasonWriter.Key("datapoint");
+		m_reasonWriter.String(cause.getDatapoint().c_str(), cause.getDatapoint().length());
+		m_reasonWriter.Key("value");
+		m_reasonWriter.Double(cause.value);
+		m_reasonWriter.Key("threshold");
+		m_reasonWriter.Double(cause.threshold);
+		m_reasonWriter.EndObject();
+	}
+	m_reasonWriter.EndObject();
+
+	return string(m_reasonBuffer.GetString(), m_reasonBuffer.GetSize());
+}
+
+/**
+ * Start the checkpoint thread, if not running
+ */
+void OutOfBound::startCheckpoints()
+{
+	if (!m_checkpointThread)
+	{
+		m_checkpointRunning = true;
+		m_checkpointThread = new thread(&OutOfBound::checkpointer, this);
+	}
+}
+
+/**
+ * Stop the checkpoint thread
+ */
+void OutOfBound::stopCheckpoints()
+{
+	if (m_checkpointThread)
+	{
+		{
+			lock_guard<mutex> guard(m_checkpointWaitMutex);
+			m_checkpointRunning = false;
+		}
+		m_checkpointCond.notify_one();
+		m_checkpointThread->join();
+		delete m_checkpointThread;
+		m_checkpointThread = NULL;
+	}
+}
+
+/**
+ * Checkpoint thread: save the rule state every checkpoint
+ * interval, off the evaluation path. A new interval is used
+ * after the current one elapses.
+ */
+void OutOfBound::checkpointer()
+{
+	unique_lock<mutex> lock(m_checkpointWaitMutex);
+	while (m_checkpointRunning)
+	{
+		auto deadline = chrono::steady_clock::now() +
+				chrono::seconds(m_checkpointInterval.load());
+		if (m_checkpointCond.wait_until(lock,
+						deadline,
+						[this] { return !m_checkpointRunning; }))
+		{
+			break;
+		}
+		lock.unlock();
+		this->checkpoint();
+		lock.lock();
+	}
+}
+
+/**
+ * Save the state of all rule sets to the state file
+ */
+void OutOfBound::checkpoint()
+{
+	lock_guard<mutex> checkpointGuard(m_checkpointMutex);
+	if (m_statePath.empty())
+	{
+		return;
+	}
+
+	shared_ptr<RuleProgram> program = this->getProgram();
+	StateSnapshot snapshot;
+	for (auto& ruleSet : program->getRuleSets())
+	{
+		string record;
+		{
+			lock_guard<mutex> guard(ruleSet.getState()->getMutex());
+			ruleSet.getState()->save(record);
+		}
+		snapshot.add(SNAPSHOT_RULE_SET,
+			     StateSnapshot::key(ruleSet.getId()),
+			     record.data(),
+			     record.length());
+	}
+
+	// Datapoint statistics
+	for (auto& ruleSet : program->getRuleSets())
+	{
+		uint64_t ruleSetKey = StateSnapshot::key(ruleSet.getId());
+		for (auto& asset : ruleSet.getAssets())
+		{
+			if (!asset.isStateful())
+			{
+				continue;
+			}
+			uint64_t assetKey = StateSnapshot::key(asset.getAsset(), ruleSetKey);
+			const vector<DatapointRule>& datapoints = asset.getDatapoints();
+			AssetState& assetState = asset.getState();
+			lock_guard<mutex> guard(assetState.getMutex());
+			vector<DatapointState>& states = assetState.getDatapointStates();
+			for (size_t i = 0; i < datapoints.size() && i < states.size(); i++)
+			{
+				uint64_t key = StateSnapshot::key(datapoints[i].getName(), assetKey);
+				if (datapoints[i].hasQualifiers())
+				{
+					snapshot.add(SNAPSHOT_QUALIFIERS,
+						     key,
+						     &states[i].qualifiers,
+						     sizeof(QualifierState));
+				}
+				if (datapoints[i].getMode() == MODE_ZSCORE)
+				{
+					snapshot.add(SNAPSHOT_RUNNING_STATS,
+						     key,
+						     &states[i].stats,
+						     sizeof(RunningStats));
+				}
+				else if (datapoints[i].getMode() == MODE_RATE)
+				{
+					snapshot.add(SNAPSHOT_RATE,
+						     key,
+						     &states[i].rate,
+						     sizeof(RateOfChange));
+				}
+				else if (datapoints[i].getMode() == MODE_PERCENTILE &&
+					 states[i].quantiles)
+				{
+					// Only the used histogram bins
+					string quantiles;
+					states[i].quantiles->save(quantiles);
+					snapshot.add(SNAPSHOT_QUANTILES,
+						     key,
+						     quantiles.data(),
+						     quantiles.length());
+				}
+			}
+		}
+	}
+
+	if (!snapshot.save(m_statePath, program->getHash()))
+	{
+		Logger::getLogger()->error("%s: failed to save rule state to '%s'",
+					   RULE_NAME, m_statePath.c_str());
+	}
+}
+
+/**
+ * Restore the state of the configured rule sets from the state file
+ */
+void OutOfBound::restore()
+{
+	lock_guard<mutex> checkpointGuard(m_checkpointMutex);
+	shared_ptr<RuleProgram> program = this->getProgram();
+	StateSnapshot snapshot;
+	if (m_statePath.empty() || !snapshot.load(m_statePath, program->getHash()))
+	{
+		return;
+	}
+
+	for (auto& ruleSet : program->getRuleSets())
+	{
+		uint32_t length;
+		const char *record = (const char *)
+			snapshot.findRecord(SNAPSHOT_RULE_SET,
+					    StateSnapshot::key(ruleSet.getId()),
+					    length);
+		if (!record)
+		{
+			continue;
+		}
+
+		RuleSetState *state = ruleSet.getState();
+		lock_guard<mutex> guard(state->getMutex());
+		if (!state->restore(record, length))
+		{
+			continue;
+		}
+		if (state->getTimestamp())
+		{
+			state->getRule()->setEvalTimestamp(state->getTimestamp());
+		}
+		state->getRule()->setState(state->isTriggered());
+	}
+
+	// Datapoint statistics
+	for (auto& ruleSet : program->getRuleSets())
+	{
+		uint64_t ruleSetKey = StateSnapshot::key(ruleSet.getId());
+		for (auto& asset : ruleSet.getAssets())
+		{
+			if (!asset.isStateful())
+			{
+				continue;
+			}
+			uint64_t assetKey = StateSnapshot::key(asset.getAsset(), ruleSetKey);
+			const vector<DatapointRule>& datapoints = asset.getDatapoints();
+			AssetState& assetState = asset.getState();
+			lock_guard<mutex> assetGuard(assetState.getMutex());
+			vector<DatapointState>& states = assetState.getDatapointStates();
+			states.resize(datapoints.size());
+			for (size_t i = 0; i < datapoints.size(); i++)
+			{
+				uint64_t key = StateSnapshot::key(datapoints[i].getName(), assetKey);
+				const void *qualifiers = snapshot.find(SNAPSHOT_QUALIFIERS,
+								       key,
+								       sizeof(QualifierState));
+				// Results of a different m_of_n are discarded
+				if (qualifiers && datapoints[i].hasQualifiers() &&
+				    (((const QualifierState *)qualifiers)->samples == 0 ||
+				     ((const QualifierState *)qualifiers)->samples == datapoints[i].getSamples()))
+				{
+					memcpy(&states[i].qualifiers, qualifiers, sizeof(QualifierState));
+				}
+				if (datapoints[i].getMode() == MODE_ZSCORE)
+				{
+					const void *stats = snapshot.find(SNAPSHOT_RUNNING_STATS,
+									  key,
+									  sizeof(RunningStats));
+					if (stats)
+					{
+						memcpy(&states[i].stats, stats, sizeof(RunningStats));
+					}
+				}
+				else if (datapoints[i].getMode() == MODE_RATE)
+				{
+					const void *rate = snapshot.find(SNAPSHOT_RATE,
+									 key,
+									 sizeof(RateOfChange));
+					if (rate)
+					{
+						memcpy(&states[i].rate, rate, sizeof(RateOfChange));
+					}
+				}
+				else if (datapoints[i].getMode() == MODE_PERCENTILE)
+				{
+					uint32_t length;
+					const void *data = snapshot.findRecord(SNAPSHOT_QUANTILES,
+									       key,
+									       length);
+					unique_ptr<QuantileWindow> quantiles(new QuantileWindow());
+					// A different window discards the saved values
+					if (data &&
+					    quantiles->load((const char *)data, length) &&
+					    fabs(quantiles->getWindow() - datapoints[i].getWindow()) < 1e-6)
+					{
+						states[i].quantiles = move(quantiles);
+					}
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Return the parse scratch memory for the calling thread
+ *
+ * @return	The thread own scratch in concurrent mode,
+ *		the rule one otherwise
+ */
+ParseScratch& OutOfBound::getScratch()
+{
+	if (m_concurrent)
+	{
+		static thread_local ParseScratch scratch;
+		return scratch;
+	}
+	return m_scratch;
+}
+
+/**
+ * Start consuming readings from a shared memory ring
+ *
+ * @param    name	The ring name
+ */
+void OutOfBound::startRing(const string& name)
+{
+	m_ringName = name;
+	m_ringRunning = true;
+	m_ringThread = new thread(&OutOfBound::ringConsumer, this);
+}
+
+/**
+ * Stop the ring consumer thread
+ */
+void OutOfBound::stopRing()
+{
+	if (m_ringThread)
+	{
+		m_ringRunning = false;
+		m_ringThread->join();
+		delete m_ringThread;
+		m_ringThread = NULL;
+	}
+	m_ringName.clear();
+}
+
+/**
+ * Ring consumer thread
+ *
+ * Readings are parsed in place in the ring slots and evaluated
+ * as plugin_eval does. Only state changes are reported back
+ * to the producer.
+ */
+void OutOfBound::ringConsumer()
+{
+	ReadingRingConsumer ring(m_ringName);
+	ParseScratch *scratch = new ParseScratch();
+	bool state = false;
+	unsigned int idle = 0;
+
+	while (m_ringRunning)
+	{
+		if (!ring.open())
+		{
+			// Producer has not created the ring yet
+			this_thread::sleep_for(chrono::milliseconds(100));
+			continue;
+		}
+
+		size_t length;
+		char *payload = ring.front(length);
+		if (!payload && length)
+		{
+			Logger::getLogger()->error("%s: ring '%s' reading of %lu bytes "
+						   "does not fit its slot, skipped",
+						   RULE_NAME,
+						   m_ringName.c_str(),
+						   (unsigned long)length);
+			continue;
+		}
+		if (!payload)
+		{
+			// Spin a little before sleeping
+			if (++idle < 64)
+			{
+				this_thread::yield();
+			}
+			else
+			{
+				this_thread::sleep_for(chrono::microseconds(500));
+			}
+			// About once a second, check the producer did not
+			// create a new ring
+			if ((idle & 2047) == 0 && ring.detachStale())
+			{
+				state = false;
+			}
+			continue;
+		}
+		idle = 0;
+
+		// Not evaluated together with plugin_eval,
+		// unless concurrent evaluation is enabled
+		unique_lock<mutex> evalLock(m_evalMutex, defer_lock);
+		if (!m_concurrent)
+		{
+			evalLock.lock();
+		}
+		bool held;
+		if (this->evalHeld(payload, length, NULL, held))
+		{
+			// Rule in hold-off: the reading is not parsed
+			ring.pop();
+			continue;
+		}
+
+		{
+			ScratchDocument doc(scratch->getValueAllocator(),
+					    1024,
+					    scratch->getStackAllocator());
+			doc.ParseInsitu(payload);
+			if (!doc.HasParseError())
+			{
+				bool eval = this->evaluate(doc);
+				if (eval != state)
+				{
+					ring.reportState(eval);
+					state = eval;
+				}
+			}
+		}
+		scratch->clear();
+		ring.pop();
+	}
+
+	delete scratch;
+}
+
+/**
+ * Return the directory of the rule state files:
+ * FOGLAMP_DATA if set, or the FOGLAMP_ROOT data directory
+ *
+ * @return	The directory path
+ */
+string stateDirectory()
+{
+	const char *data = getenv("FOGLAMP_DATA");
+	if (data)
+	{
+		return data;
+	}
+	const char *root = getenv("FOGLAMP_ROOT");
+	return string(root ? root : "/usr/local/foglamp") + "/data";
+}
+
+/**
+ * Return a name usable in a file name: characters other
+ * than letters, digits, '.', '_' and '-' are replaced by '_'
+ *
+ * @param    name	The name
+ * @return		The file name part
+ */
+string fileName(const string& name)
+{
+	string ret = name;
+	for (auto& c : ret)
+	{
+		if (!isalnum((unsigned char)c) && c != '.' && c != '_' && c != '-')
+		{
+			c = '_';
+		}
+	}
+	return ret;
+}
+
+/**
+ * Configure the rule plugin
+ *
+ * @param    config	The configuration object to process
+ */
+void OutOfBound::configure(const ConfigCategory& config)
+{
+	// Optional shared memory ring ingestion
+	string ringName;
+	if (config.itemExists("ring_buffer"))
+	{
+		ringName = config.getValue("ring_buffer");
+	}
+	if (ringName.compare(m_ringName) != 0)
+	{
+		stopRing();
+		if (!ringName.empty())
+		{
+			startRing(ringName);
+		}
+	}
+
+	if (config.itemExists("concurrent_eval"))
+	{
+		m_concurrent = config.getValue("concurrent_eval").compare("true") == 0;
+	}
+
+	// Category name of the first configuration, used for the state file
+	if (m_name.empty())
+	{
+		m_name = config.getName();
+	}
+	bool persist = config.itemExists("persist_state") &&
+		       config.getValue("persist_state").compare("true") == 0;
+	{
+		lock_guard<mutex> checkpointGuard(m_checkpointMutex);
+		m_statePath = persist ?
+				stateDirectory() + "/" + RULE_NAME + "_" + fileName(m_name) + ".state" :
+				"";
+	}
+	if (persist && config.itemExists("checkpoint_interval"))
+	{
+		m_checkpointInterval = atol(config.getValue("checkpoint_interval").c_str());
+	}
+	else
+	{
+		m_checkpointInterval = 0;
+	}
+	if (m_checkpointInterval > 0)
+	{
+		startCheckpoints();
+	}
+	else
+	{
+		stopCheckpoints();
+	}
+
+	if (config.itemExists("payload_cache"))
+	{
+		m_payloadCache = config.getValue("payload_cache").compare("true") == 0;
+	}
+
+	string JSONrules = config.getValue("rule_config");
+
+	Document doc;
+	doc.Parse(JSONrules.c_str());
+
+	if (doc.HasParseError())
+	{
+		return;
+	}
+
+	bool hasRules = doc.HasMember("rules") && doc["rules"].IsArray();
+	bool hasRuleSets = doc.HasMember("rule_sets") && doc["rule_sets"].IsArray();
+	if (!hasRules && !hasRuleSets)
+	{
+		return;
+	}
+
+	// Threshold updates are not lost in the new program
+	lock_guard<mutex> programGuard(m_programMutex);
+	shared_ptr<RuleProgram> current = this->getProgram();
+	shared_ptr<RuleProgram> program(new RuleProgram());
+
+	// A saved state is only restored for the same rule configuration
+	StringBuffer normalized;
+	Writer<StringBuffer> normalizer(normalized);
+	doc.Accept(normalizer);
+	program->setHash(StateSnapshot::key(string(normalized.GetString(),
+						   normalized.GetSize())));
+
+	// Get defined rules
+	RuleSet& primary = program->addRuleSet("", m_primaryState);
+	this->configureOptions(doc, primary);
+	if (hasRules)
+	{
+		this->configureRules(doc["rules"], primary, &current->getRuleSets().front());
+	}
+
+	/**
+	 * Get additional rule sets:
+	 * each one has an id and a "rules" array,
+	 * evaluated against the same readings.
+	 * The state of a rule set is kept across
+	 * reconfigurations if its id does not change.
+	 */
+	if (hasRuleSets)
+	{
+		for (auto& ruleSet : doc["rule_sets"].GetArray())
+		{
+			if (!ruleSet.IsObject() ||
+			    !ruleSet.HasMember("id") ||
+			    !ruleSet["id"].IsString() ||
+			    !ruleSet.HasMember("rules") ||
+			    !ruleSet["rules"].IsArray())
+			{
+				continue;
+			}
+			string id = ruleSet["id"].GetString();
+			if (id.empty() || program->findRuleSet(id))
+			{
+				Logger::getLogger()->error("%s: rule set id '%s' is empty or duplicated",
+							   RULE_NAME, id.c_str());
+				continue;
+			}
+
+			const RuleSet *previous = current->findRuleSet(id);
+			shared_ptr<RuleSetState> state = previous ?
+							previous->getSharedState() :
+							shared_ptr<RuleSetState>(new RuleSetState());
+			RuleSet& added = program->addRuleSet(id, state);
+			this->configureOptions(ruleSet, added);
+			this->configureRules(ruleSet["rules"], added, previous);
+		}
+	}
+
+	// Asset patterns are subscribed to through the known assets
+	if (doc.HasMember("known_assets") && doc["known_assets"].IsArray())
+	{
+		for (auto& asset : doc["known_assets"].GetArray())
+		{
+			if (asset.IsString())
+			{
+				program->addKnownAsset(asset.GetString());
+			}
+		}
+	}
+	for (auto& ruleSet : program->getRuleSets())
+	{
+		if (!ruleSet.hasAssetPatterns())
+		{
+			continue;
+		}
+		set<int> matched;
+		vector<int> matches;
+		for (auto& known : program->getKnownAssets())
+		{
+			const vector<int>& ids = ruleSet.getAssetMatcher().match(known.c_str(),
+										 known.length(),
+										 matches);
+			matched.insert(ids.begin(), ids.end());
+		}
+		const vector<AssetRule>& assets = ruleSet.getAssets();
+		for (size_t i = 0; i < assets.size(); i++)
+		{
+			if (assets[i].isPattern() && matched.count(i) == 0)
+			{
+				Logger::getLogger()->warn("%s: asset pattern '%s' matches no known_assets, "
+							  "the notification service will not deliver "
+							  "its readings",
+							  RULE_NAME,
+							  assets[i].getAsset().c_str());
+			}
+		}
+	}
+
+	// Evaluations in progress keep the previous program
+	atomic_store(&m_program, program);
+}
+
+/**
+ * Configure the rule set options
+ *
+ * "edge_triggered": report only the cleared to triggered transition
+ * "rearm_after_clear": with edge_triggered, report again the next
+ * transition once the rule is cleared, default true. If false the
+ * transition is reported once until the rule set is reconfigured.
+ * "holdoff": seconds, measured on reading timestamps, during which
+ * the rule set is not evaluated after a trigger.
+ *
+ * @param    options	The JSON object with rule set options
+ * @param    ruleSet	The rule set to configure
+ */
+void OutOfBound::configureOptions(const Value& options, RuleSet& ruleSet)
+{
+	bool edge = false;
+	bool rearm = true;
+	if (options.HasMember("edge_triggered") &&
+	    options["edge_triggered"].IsBool())
+	{
+		edge = options["edge_triggered"].GetBool();
+	}
+	if (options.HasMember("rearm_after_clear") &&
+	    options["rearm_after_clear"].IsBool())
+	{
+		rearm = options["rearm_after_clear"].GetBool();
+	}
+	ruleSet.setEdgeTriggered(edge, rearm);
+
+	if (options.HasMember("holdoff") &&
+	    options["holdoff"].IsNumber() &&
+	    options["holdoff"].GetDouble() > 0)
+	{
+		ruleSet.setHoldOff(options["holdoff"].GetDouble());
+	}
+
+	if (options.HasMember("latest_value_max_age") &&
+	    options["latest_value_max_age"].IsNumber() &&
+	    options["latest_value_max_age"].GetDouble() > 0)
+	{
+		ruleSet.setMaxAge(options["latest_value_max_age"].GetDouble());
+	}
+
+	if (!edge || !rearm)
+	{
+		// A reconfiguration re-arms one shot rule sets
+		lock_guard<mutex> guard(ruleSet.getState()->getMutex());
+		ruleSet.getState()->setArmed(true);
+	}
+}
+
+/**
+ * Configure the asset rules of a rule set
+ *
+ * The whole rules array is validated and compiled in one pass
+ * into pre-sized containers.
+ *
+ * The result is then compared with the current rule set:
+ * asset rules with the same definition are reused with their
+ * compiled patterns and runtime state, added and modified asset
+ * rules are compiled and start with a new state.
+ * The triggers are built from the rule program by plugin_triggers.
+ *
+ * @param    rules	The JSON array of rules
+ * @param    ruleSet	The rule set to add asset rules to
+ * @param    previous	The current rule set with the same id, or NULL
+ */
+void OutOfBound::configureRules(const Value& rules,
+				RuleSet& ruleSet,
+				const RuleSet *previous)
+{
+	ruleSet.reserve(rules.Size());
+
+	/**
+	 * For each rule fetch:
+	 * asset: name,
+	 * evaluation_type: value
+	 * time_interval
+	 * datapoints array with max_allowed_value
+	 * eval_all_datapoins: check all datapoint values
+	 * or just eval the rule for at least one datapoint
+	 */
+	for (auto& rule : rules.GetArray())
+	{
+		if (!rule.IsObject() ||
+		    !rule.HasMember("asset") ||
+		    !rule.HasMember("datapoints"))
+		{
+			continue;
+		}
+
+		const Value& asset = rule["asset"];
+		if (!asset.IsObject() ||
+		    !asset.HasMember("name") ||
+		    !asset["name"].IsString() ||
+		    asset["name"].GetStringLength() == 0)
+		{
+			continue;
+		}
+		string assetName = asset["name"].GetString();
+		if (!validName(assetName))
+		{
+			continue;
+		}
+
+		bool window_evaluation = false;
+		// window_data can be empty, it means use SingleItem values
+		string window_data;
+		// time_interval might be not present only
+		// if window_data is empty
+		unsigned int timeInterval = 0;
+		if (rule.HasMember("evaluation_data") &&
+		    rule["evaluation_data"].IsObject() &&
+		    rule["evaluation_data"].HasMember("value") &&
+		    rule["evaluation_data"]["value"].IsString())
+		{
+			const Value& type = rule["evaluation_data"];
+			string evaluation_data = type["value"].GetString();
+			window_evaluation = evaluation_data.compare("Window") == 0;
+		}
+		if (window_evaluation &&
+		    rule.HasMember("window_data") &&
+		    rule["window_data"].IsObject() &&
+		    rule["window_data"].HasMember("value") &&
+		    rule["window_data"]["value"].IsString())
+		{
+			const Value& type = rule["window_data"];
+			// Set window_data value
+			window_data = type["value"].GetString();
+			if (!window_data.empty() &&
+			    rule.HasMember("time_interval") &&
+			    rule["time_interval"].IsInt())
+			{
+				const Value& interval = rule["time_interval"];
+				timeInterval = interval.GetInt();
+			}
+			else
+			{
+				// Log message
+			}
+		}
+
+		const Value& datapoints = rule["datapoints"];
+		bool evalAlldatapoints = true;
+		bool foundDatapoints = false;
+		if (rule.HasMember("eval_all_datapoints") &&
+		    rule["eval_all_datapoints"].IsBool())
+		{
+			evalAlldatapoints = rule["eval_all_datapoints"].GetBool();
+		}
+
+		if (datapoints.IsArray())
+		{
+			for (auto& d : datapoints.GetArray())
+			{
+				if (d.IsObject() &&
+				    d.HasMember("name") &&
+				    d["name"].IsString())
+				{
+					foundDatapoints = true;
+
+					string dataPointName = d["name"].GetString();
+					if (!DatapointRule::isPath(dataPointName) &&
+					    !validName(dataPointName))
+					{
+						continue;
+					}
+					// max_allowed_value is specific for this rule
+					if (d.HasMember("trigger_value") &&
+					    d["trigger_value"].IsNumber())
+					{
+						double maxVal = d["trigger_value"].GetDouble();
+						DatapointRule datapoint(dataPointName, maxVal);
+						if (!configureExpression(d, datapoint) ||
+						    !configureMagnitude(d, datapoint) ||
+						    !configureMode(d, datapoint) ||
+						    !configureBandEnergy(d, datapoint) ||
+						    !configureQualifiers(d, datapoint))
+						{
+							continue;
+						}
+						if (datapoint.getMode() == MODE_RATE &&
+						    window_data.compare("All") == 0)
+						{
+							// The values of a window array share
+							// the same reading timestamp
+							Logger::getLogger()->error("%s: datapoint '%s' rate mode "
+										   "does not support the All window_data",
+										   RULE_NAME,
+										   dataPointName.c_str());
+							continue;
+						}
+						if (datapoint.isBandEnergy() &&
+						    window_data.compare("All") != 0)
+						{
+							Logger::getLogger()->error("%s: datapoint '%s' band_energy "
+										   "needs the All window_data",
+										   RULE_NAME,
+										   dataPointName.c_str());
+							continue;
+						}
+						if (datapoint.isStateful() &&
+						    NameMatcher::isPattern(assetName))
+						{
+							Logger::getLogger()->error("%s: asset pattern '%s' only "
+										   "supports the limit mode with no qualifiers",
+										   RULE_NAME,
+										   assetName.c_str());
+							continue;
+						}
+						bool created;
+						AssetRule& assetRule = ruleSet.addAsset(assetName,
+											evalAlldatapoints,
+											window_data,
+											timeInterval,
+											created);
+						if (created)
+						{
+							assetRule.reserve(datapoints.Size());
+						}
+						assetRule.addDatapoint(datapoint);
+					}
+				}
+			}
+		}
+		if (!foundDatapoints)
+		{
+			// Log message
+		}
+	}
+
+	// Asset and datapoint name patterns, unchanged asset rules
+	// are reused with their state
+	size_t kept = ruleSet.compilePatterns(previous);
+	const vector<AssetRule>& assets = ruleSet.getAssets();
+
+	if (previous && !previous->getAssets().empty())
+	{
+		Logger::getLogger()->info("%s: rule set '%s' reconfigured, "
+					  "%lu asset rules unchanged, %lu added or modified",
+					  RULE_NAME,
+					  ruleSet.getId().c_str(),
+					  (unsigned long)kept,
+					  (unsigned long)(assets.size() - kept));
+	}
+}
+
+/**
+ * Update datapoint thresholds of the current rule program
+ *
+ * The patch is a JSON object, or an array of objects, with
+ * "asset", "datapoint", "trigger_value" and an optional
+ * "rule_set" id, the "rules" rule set if missing:
+ *
+ *    { "asset": "flow", "datapoint": "random", "trigger_value": 98.5 }
+ *
+ * The patch is applied to a copy of the current rule program which
+ * then replaces it, so an evaluation sees either none or all of the
+ * patch. The copy shares the asset rule states: the updated asset
+ * rules get a new revision, so no result memoised with the previous
+ * limits is used. Band energy datapoints are not patched.
+ * The rule triggers do not change.
+ * A reconfiguration restores the rule_config limits.
+ *
+ * @param    patch	The JSON threshold patch
+ * @return		True if all the thresholds have been updated
+ */
+bool OutOfBound::updateThresholds(const string& patch)
+{
+	Document doc;
+	doc.Parse(patch.c_str(), patch.length());
+	if (doc.HasParseError() || (!doc.IsObject() && !doc.IsArray()))
+	{
+		Logger::getLogger()->error("%s: invalid threshold patch '%s'",
+					   RULE_NAME, patch.c_str());
+		return false;
+	}
+
+	lock_guard<mutex> programGuard(m_programMutex);
+	shared_ptr<RuleProgram> program(this->getProgram()->clone());
+	set<AssetRule *> updated;
+	bool ret = true;
+	SizeType count = doc.IsArray() ? doc.Size() : 1;
+	for (SizeType i = 0; i < count; i++)
+	{
+		const Value& item = doc.IsArray() ? doc[i] : doc;
+		if (!item.IsObject() ||
+		    !item.HasMember("asset") || !item["asset"].IsString() ||
+		    !item.HasMember("datapoint") || !item["datapoint"].IsString() ||
+		    !item.HasMember("trigger_value") || !item["trigger_value"].IsNumber() ||
+		    (item.HasMember("rule_set") && !item["rule_set"].IsString()))
+		{
+			Logger::getLogger()->error("%s: invalid threshold patch item",
+						   RULE_NAME);
+			ret = false;
+			continue;
+		}
+
+		string id = item.HasMember("rule_set") ? item["rule_set"].GetString() : "";
+		RuleSet *ruleSet = program->findRuleSet(id);
+		AssetRule *assetRule = ruleSet ?
+					ruleSet->findAsset(item["asset"].GetString()) :
+					NULL;
+		if (!assetRule)
+		{
+			Logger::getLogger()->error("%s: threshold patch for unknown asset '%s'",
+						   RULE_NAME,
+						   item["asset"].GetString());
+			ret = false;
+			continue;
+		}
+
+		bool found = false;
+		bool patched = false;
+		for (auto& datapoint : assetRule->getDatapoints())
+		{
+			if (datapoint.getName().compare(item["datapoint"].GetString()) != 0)
+			{
+				continue;
+			}
+			found = true;
+			if (datapoint.isBandEnergy())
+			{
+				// The bands have their own limits
+				Logger::getLogger()->error("%s: threshold patch for band_energy "
+							   "datapoint '%s' is not supported",
+							   RULE_NAME,
+							   item["datapoint"].GetString());
+				ret = false;
+				continue;
+			}
+			datapoint.setLimit(item["trigger_value"].GetDouble());
+			patched = true;
+		}
+		if (patched)
+		{
+			updated.insert(assetRule);
+		}
+		else if (!found)
+		{
+			Logger::getLogger()->error("%s: threshold patch for unknown datapoint '%s'",
+						   RULE_NAME,
+						   item["datapoint"].GetString());
+			ret = false;
+		}
+	}
+
+	if (updated.empty())
+	{
+		return ret;
+	}
+	for (AssetRule *assetRule : updated)
+	{
+		assetRule->newRevision();
+	}
+
+	// Evaluations in progress keep the previous program
+	atomic_store(&m_program, program);
+
+	return ret;
 }
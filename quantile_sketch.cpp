@@ -0,0 +1,520 @@
+/**
+ * FogLAMP OutOfBound streaming quantile sketch
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <math.h>
+#include <string.h>
+#include <limits.h>
+#include "quantile_sketch.h"
+
+using namespace std;
+
+// Bin ratio: values in a bin are within the accuracy of its value
+static const double sketchGamma = (1 + QUANTILE_SKETCH_ACCURACY) / (1 - QUANTILE_SKETCH_ACCURACY);
+static const double logGamma = log(sketchGamma);
+
+/**
+ * Remove all the counts
+ */
+void QuantileStore::clear()
+{
+	m_count = 0;
+	m_offset = 0;
+	m_minKey = INT_MAX;
+	m_maxKey = INT_MIN;
+	memset(m_bins, 0, sizeof(m_bins));
+}
+
+/**
+ * Count a magnitude
+ *
+ * @param    key	The magnitude key
+ * @param    count	The number of times it is counted
+ */
+void QuantileStore::add(int key, uint32_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	if (m_count == 0)
+	{
+		// Room for magnitudes on both sides of the first one
+		m_offset = key - QUANTILE_STORE_BINS / 2;
+	}
+	else if (key >= m_offset + QUANTILE_STORE_BINS)
+	{
+		// Slide the bins up, merging the lowest ones
+		int shift = key - (m_offset + QUANTILE_STORE_BINS - 1);
+		uint32_t merged = 0;
+		for (int i = 0; i < QUANTILE_STORE_BINS && i <= shift; i++)
+		{
+			merged += m_bins[i];
+		}
+		if (shift < QUANTILE_STORE_BINS)
+		{
+			memmove(m_bins, m_bins + shift,
+				(QUANTILE_STORE_BINS - shift) * sizeof(m_bins[0]));
+			memset(m_bins + QUANTILE_STORE_BINS - shift, 0,
+			       shift * sizeof(m_bins[0]));
+		}
+		else
+		{
+			memset(m_bins, 0, sizeof(m_bins));
+		}
+		m_bins[0] = merged;
+		m_offset += shift;
+		if (m_minKey < m_offset)
+		{
+			m_minKey = m_offset;
+		}
+	}
+
+	if (key < m_offset)
+	{
+		// Below range: counted in the lowest bin
+		key = m_offset;
+	}
+	m_bins[key - m_offset] += count;
+	m_count += count;
+	if (key < m_minKey)
+	{
+		m_minKey = key;
+	}
+	if (key > m_maxKey)
+	{
+		m_maxKey = key;
+	}
+}
+
+/**
+ * Add the counts of another store
+ *
+ * @param    other	The store to merge
+ */
+void QuantileStore::merge(const QuantileStore& other)
+{
+	if (other.m_count == 0)
+	{
+		return;
+	}
+	for (int k = other.m_minKey; k <= other.m_maxKey; k++)
+	{
+		add(k, other.getCount(k));
+	}
+}
+
+/**
+ * Saved store: the used bins follow the header
+ */
+struct QuantileStoreHeader
+{
+	uint64_t	count;
+	int32_t		offset;
+	int32_t		minKey;
+	int32_t		maxKey;
+	int32_t		pad;
+};
+
+/**
+ * Append the store to saved data: only the used bins
+ *
+ * @param    data	The saved data, updated
+ */
+void QuantileStore::save(string& data) const
+{
+	QuantileStoreHeader header;
+	header.count = m_count;
+	header.offset = m_offset;
+	header.minKey = m_minKey;
+	header.maxKey = m_maxKey;
+	header.pad = 0;
+	data.append((const char *)&header, sizeof(header));
+	if (m_count > 0)
+	{
+		data.append((const char *)&m_bins[m_minKey - m_offset],
+			    (m_maxKey - m_minKey + 1) * sizeof(m_bins[0]));
+	}
+}
+
+/**
+ * Load the store from saved data
+ *
+ * @param    data	The saved data
+ * @param    end	The end of the saved data
+ * @return		The data after the store, NULL if invalid
+ */
+const char *QuantileStore::load(const char *data, const char *end)
+{
+	QuantileStoreHeader header;
+	if (data + sizeof(header) > end)
+	{
+		return NULL;
+	}
+	memcpy(&header, data, sizeof(header));
+	data += sizeof(header);
+
+	clear();
+	if (header.count == 0)
+	{
+		return data;
+	}
+	size_t bins = (size_t)header.maxKey - header.minKey + 1;
+	if (header.minKey < header.offset ||
+	    header.maxKey >= header.offset + QUANTILE_STORE_BINS ||
+	    header.minKey > header.maxKey ||
+	    data + bins * sizeof(m_bins[0]) > end)
+	{
+		return NULL;
+	}
+	m_count = header.count;
+	m_offset = header.offset;
+	m_minKey = header.minKey;
+	m_maxKey = header.maxKey;
+	memcpy(&m_bins[m_minKey - m_offset], data, bins * sizeof(m_bins[0]));
+	return data + bins * sizeof(m_bins[0]);
+}
+
+/**
+ * Remove all the values
+ */
+void QuantileSketch::clear()
+{
+	m_count = 0;
+	m_zero = 0;
+	m_positive.clear();
+	m_negative.clear();
+}
+
+/**
+ * Return the bin key of a magnitude
+ *
+ * @param    magnitude	The value magnitude, not less
+ *			than QUANTILE_SKETCH_MIN_VALUE
+ * @return		The key, ordered as the magnitudes
+ */
+int QuantileSketch::key(double magnitude)
+{
+	return (int)ceil(log(magnitude) / logGamma);
+}
+
+/**
+ * Return the magnitude of a bin
+ *
+ * @param    key	The bin key
+ * @return		The magnitude within the accuracy
+ *			of all the magnitudes of the bin
+ */
+double QuantileSketch::value(int key)
+{
+	return 2 * pow(sketchGamma, key) / (sketchGamma + 1);
+}
+
+/**
+ * Add a value
+ *
+ * @param    value	The value to add
+ */
+void QuantileSketch::add(double value)
+{
+	if (isnan(value))
+	{
+		return;
+	}
+	if (fabs(value) < QUANTILE_SKETCH_MIN_VALUE)
+	{
+		m_zero++;
+	}
+	else if (value > 0)
+	{
+		m_positive.add(key(value));
+	}
+	else
+	{
+		m_negative.add(key(-value));
+	}
+	m_count++;
+}
+
+/**
+ * Add the values of another sketch
+ *
+ * @param    other	The sketch to merge
+ */
+void QuantileSketch::merge(const QuantileSketch& other)
+{
+	m_count += other.m_count;
+	m_zero += other.m_zero;
+	m_positive.merge(other.m_positive);
+	m_negative.merge(other.m_negative);
+}
+
+/**
+ * Append the sketch to saved data
+ *
+ * @param    data	The saved data, updated
+ */
+void QuantileSketch::save(string& data) const
+{
+	data.append((const char *)&m_count, sizeof(m_count));
+	data.append((const char *)&m_zero, sizeof(m_zero));
+	m_positive.save(data);
+	m_negative.save(data);
+}
+
+/**
+ * Load the sketch from saved data
+ *
+ * @param    data	The saved data
+ * @param    end	The end of the saved data
+ * @return		The data after the sketch, NULL if invalid
+ */
+const char *QuantileSketch::load(const char *data, const char *end)
+{
+	if (data + sizeof(m_count) + sizeof(m_zero) > end)
+	{
+		return NULL;
+	}
+	memcpy(&m_count, data, sizeof(m_count));
+	data += sizeof(m_count);
+	memcpy(&m_zero, data, sizeof(m_zero));
+	data += sizeof(m_zero);
+	data = m_positive.load(data, end);
+	return data ? m_negative.load(data, end) : NULL;
+}
+
+/**
+ * Set the window length and remove all the values
+ *
+ * @param    window	The window length in seconds
+ */
+void QuantileWindow::init(double window)
+{
+	m_bucketLength = window / QUANTILE_WINDOW_BUCKETS;
+	for (int i = 0; i < QUANTILE_WINDOW_BUCKETS; i++)
+	{
+		m_epochs[i] = INT64_MIN / 2;
+		m_buckets[i].clear();
+	}
+}
+
+/**
+ * Add a value
+ *
+ * @param    value	The value
+ * @param    timestamp	The reading timestamp
+ */
+void QuantileWindow::add(double value, double timestamp)
+{
+	int64_t e = epoch(timestamp);
+	int bucket = bucketOf(e);
+	if (m_epochs[bucket] != e)
+	{
+		if (m_epochs[bucket] > e)
+		{
+			// Older than the window
+			return;
+		}
+		m_epochs[bucket] = e;
+		m_buckets[bucket].clear();
+	}
+	m_buckets[bucket].add(value);
+}
+
+/**
+ * Add the values of another window of the same length,
+ * bucket by bucket: buckets older than the ones of
+ * the window are ignored.
+ *
+ * @param    other	The window to merge
+ * @return		False if the window lengths differ
+ */
+bool QuantileWindow::merge(const QuantileWindow& other)
+{
+	if (fabs(other.m_bucketLength - m_bucketLength) > 1e-9 * m_bucketLength)
+	{
+		return false;
+	}
+	for (int i = 0; i < QUANTILE_WINDOW_BUCKETS; i++)
+	{
+		int64_t e = other.m_epochs[i];
+		if (other.m_buckets[i].getCount() == 0)
+		{
+			continue;
+		}
+		int bucket = bucketOf(e);
+		if (m_epochs[bucket] < e)
+		{
+			m_epochs[bucket] = e;
+			m_buckets[bucket].clear();
+		}
+		if (m_epochs[bucket] == e)
+		{
+			m_buckets[bucket].merge(other.m_buckets[i]);
+		}
+	}
+	return true;
+}
+
+/**
+ * Append the window to saved data
+ *
+ * @param    data	The saved data, updated
+ */
+void QuantileWindow::save(string& data) const
+{
+	data.append((const char *)&m_bucketLength, sizeof(m_bucketLength));
+	data.append((const char *)m_epochs, sizeof(m_epochs));
+	for (int i = 0; i < QUANTILE_WINDOW_BUCKETS; i++)
+	{
+		m_buckets[i].save(data);
+	}
+}
+
+/**
+ * Load the window from saved data
+ *
+ * @param    data	The saved data
+ * @param    length	The saved data length
+ * @return		False if the data is invalid
+ */
+bool QuantileWindow::load(const char *data, size_t length)
+{
+	const char *end = data + length;
+	if (length < sizeof(m_bucketLength) + sizeof(m_epochs))
+	{
+		return false;
+	}
+	memcpy(&m_bucketLength, data, sizeof(m_bucketLength));
+	data += sizeof(m_bucketLength);
+	memcpy(m_epochs, data, sizeof(m_epochs));
+	data += sizeof(m_epochs);
+	for (int i = 0; i < QUANTILE_WINDOW_BUCKETS && data; i++)
+	{
+		data = m_buckets[i].load(data, end);
+	}
+	return data == end && m_bucketLength > 0;
+}
+
+/**
+ * Return the number of values in the window
+ *
+ * @param    timestamp	The current reading timestamp
+ * @return		The number of values
+ */
+uint64_t QuantileWindow::getCount(double timestamp) const
+{
+	int64_t e = epoch(timestamp);
+	uint64_t count = 0;
+	for (int i = 0; i < QUANTILE_WINDOW_BUCKETS; i++)
+	{
+		if (isCurrent(i, e))
+		{
+			count += m_buckets[i].getCount();
+		}
+	}
+	return count;
+}
+
+/**
+ * Return the number of values of a bin in the window
+ *
+ * @param    negative	The store of negative values
+ * @param    key	The bin key
+ * @param    epoch	The current bucket epoch
+ * @return		The number of values
+ */
+uint64_t QuantileWindow::getCount(bool negative, int key, int64_t epoch) const
+{
+	uint64_t count = 0;
+	for (int i = 0; i < QUANTILE_WINDOW_BUCKETS; i++)
+	{
+		if (isCurrent(i, epoch))
+		{
+			count += m_buckets[i].getStore(negative).getCount(key);
+		}
+	}
+	return count;
+}
+
+/**
+ * Return a quantile of the values in the window
+ *
+ * The bins of all the buckets are walked from the nearest end,
+ * so high and low quantiles only visit a few bins.
+ *
+ * @param    q		The quantile, between 0 and 1
+ * @param    timestamp	The current reading timestamp
+ * @return		The quantile value, NAN if there are no values
+ */
+double QuantileWindow::quantile(double q, double timestamp) const
+{
+	int64_t e = epoch(timestamp);
+	uint64_t count = 0;
+	uint64_t zero = 0;
+	int minKey[2] = { INT_MAX, INT_MAX };
+	int maxKey[2] = { INT_MIN, INT_MIN };
+	for (int i = 0; i < QUANTILE_WINDOW_BUCKETS; i++)
+	{
+		if (!isCurrent(i, e))
+		{
+			continue;
+		}
+		count += m_buckets[i].getCount();
+		zero += m_buckets[i].getZeroCount();
+		for (int s = 0; s < 2; s++)
+		{
+			const QuantileStore& store = m_buckets[i].getStore(s);
+			if (store.getMinKey() < minKey[s])
+			{
+				minKey[s] = store.getMinKey();
+			}
+			if (store.getMaxKey() > maxKey[s])
+			{
+				maxKey[s] = store.getMaxKey();
+			}
+		}
+	}
+	if (count == 0)
+	{
+		return NAN;
+	}
+
+	// Rank of the quantile, from the nearest end
+	bool fromTop = q > 0.5;
+	uint64_t rank = (uint64_t)((fromTop ? 1 - q : q) * (count - 1));
+	uint64_t seen = 0;
+
+	// Far end store: largest magnitudes first
+	bool negative = !fromTop;
+	for (int k = maxKey[negative]; k >= minKey[negative]; k--)
+	{
+		seen += getCount(negative, k, e);
+		if (seen > rank)
+		{
+			return negative ? -QuantileSketch::value(k) : QuantileSketch::value(k);
+		}
+	}
+	seen += zero;
+	if (seen > rank)
+	{
+		return 0;
+	}
+	// Other store: smallest magnitudes first
+	negative = !negative;
+	for (int k = minKey[negative]; k <= maxKey[negative]; k++)
+	{
+		seen += getCount(negative, k, e);
+		if (seen > rank)
+		{
+			return negative ? -QuantileSketch::value(k) : QuantileSketch::value(k);
+		}
+	}
+	return 0;
+}
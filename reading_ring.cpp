@@ -0,0 +1,357 @@
+/**
+ * FogLAMP OutOfBound shared memory reading ring
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <new>
+#include "reading_ring.h"
+
+using namespace std;
+
+/**
+ * Ring constructor
+ *
+ * @param    name	The POSIX shared memory object name
+ */
+ReadingRing::ReadingRing(const string& name) :
+			m_header(NULL), m_slots(NULL), m_slotCount(0), m_slotSize(0),
+			m_size(0), m_inode(0)
+{
+	m_name = name[0] == '/' ? name : "/" + name;
+}
+
+/**
+ * Ring destructor: unmap shared memory
+ */
+ReadingRing::~ReadingRing()
+{
+	detach();
+}
+
+/**
+ * Create and map the shared memory segment
+ *
+ * @param    slotCount	Number of slots, rounded to a power of two
+ * @param    slotSize	Size of each slot in bytes
+ * @return		True on success
+ */
+bool ReadingRing::create(uint32_t slotCount, uint32_t slotSize)
+{
+	uint32_t count = 1;
+	while (count < slotCount)
+	{
+		count <<= 1;
+	}
+	// Room for length, payload and NUL terminator, 8 bytes aligned
+	slotSize = (slotSize + sizeof(uint32_t) + 1 + 7) & ~7U;
+
+	// A segment left by a previous producer is never reset in place:
+	// a consumer could attach to it while the header is rewritten.
+	// It is unlinked and a new one created, consumers still mapping
+	// the old one detach when they see it is stale.
+	shm_unlink(m_name.c_str());
+	int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+	if (fd < 0)
+	{
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	m_inode = st.st_ino;
+	m_size = sizeof(ReadingRingHeader) + (size_t)count * slotSize;
+	if (ftruncate(fd, m_size) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	void *addr = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		return false;
+	}
+
+	m_header = new (addr) ReadingRingHeader;
+	m_header->slotCount = count;
+	m_header->slotSize = slotSize;
+	m_header->head.store(0);
+	m_header->tail.store(0);
+	m_header->stateSequence.store(0);
+	m_header->state.store(0);
+	m_header->version = READING_RING_VERSION;
+	// Magic written last: the consumer does not attach before this
+	__atomic_store_n(&m_header->magic, READING_RING_MAGIC, __ATOMIC_RELEASE);
+	m_slots = (char *)addr + sizeof(ReadingRingHeader);
+	m_slotCount = count;
+	m_slotSize = slotSize;
+
+	return true;
+}
+
+/**
+ * Map an existing shared memory segment created by the producer
+ *
+ * @return	True on success
+ */
+bool ReadingRing::attach()
+{
+	int fd = shm_open(m_name.c_str(), O_RDWR, 0);
+	if (fd < 0)
+	{
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 ||
+	    (size_t)st.st_size < sizeof(ReadingRingHeader))
+	{
+		close(fd);
+		return false;
+	}
+	void *addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		return false;
+	}
+
+	ReadingRingHeader *header = (ReadingRingHeader *)addr;
+	uint32_t slotCount = header->slotCount;
+	uint32_t slotSize = header->slotSize;
+	if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != READING_RING_MAGIC ||
+	    header->version != READING_RING_VERSION ||
+	    slotCount == 0 ||
+	    (slotCount & (slotCount - 1)) != 0 ||
+	    slotSize < sizeof(uint32_t) + 1 ||
+	    sizeof(ReadingRingHeader) + (size_t)slotCount * slotSize >
+	    (size_t)st.st_size)
+	{
+		munmap(addr, st.st_size);
+		return false;
+	}
+
+	m_header = header;
+	m_size = st.st_size;
+	m_slots = (char *)addr + sizeof(ReadingRingHeader);
+	m_slotCount = slotCount;
+	m_slotSize = slotSize;
+	m_inode = st.st_ino;
+
+	return true;
+}
+
+/**
+ * Check whether the mapped segment is still the one with the ring name
+ *
+ * @return	False if the segment has been removed or replaced
+ *		by a new producer
+ */
+bool ReadingRing::isCurrent() const
+{
+	int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+	{
+		return false;
+	}
+	struct stat st;
+	bool ret = fstat(fd, &st) == 0 && st.st_ino == m_inode;
+	close(fd);
+	return ret;
+}
+
+/**
+ * Unmap the shared memory segment
+ */
+void ReadingRing::detach()
+{
+	if (m_header)
+	{
+		munmap(m_header, m_size);
+		m_header = NULL;
+		m_slots = NULL;
+		m_slotCount = 0;
+		m_slotSize = 0;
+		m_size = 0;
+		m_inode = 0;
+	}
+}
+
+/**
+ * Producer constructor: create the shared memory ring
+ *
+ * @param    name	The ring name, as set in the rule "ring_buffer" item
+ * @param    slotCount	Number of readings the ring can hold
+ * @param    slotSize	Maximum size of one JSON reading document
+ */
+ReadingRingProducer::ReadingRingProducer(const string& name,
+					 uint32_t slotCount,
+					 uint32_t slotSize) :
+					 ReadingRing(name),
+					 m_stateSequence(0)
+{
+	create(slotCount, slotSize);
+}
+
+/**
+ * Producer destructor: remove the shared memory object
+ */
+ReadingRingProducer::~ReadingRingProducer()
+{
+	if (isMapped())
+	{
+		detach();
+		shm_unlink(m_name.c_str());
+	}
+}
+
+/**
+ * Append a JSON reading document to the ring
+ *
+ * @param    payload	The JSON document, same format as plugin_eval input
+ * @param    length	The document length
+ * @return		False if the ring is full or the document too big
+ */
+bool ReadingRingProducer::push(const char *payload, size_t length)
+{
+	if (!isMapped() ||
+	    length + sizeof(uint32_t) + 1 > m_slotSize)
+	{
+		return false;
+	}
+
+	uint64_t head = m_header->head.load(memory_order_relaxed);
+	if (head - m_header->tail.load(memory_order_acquire) >= m_slotCount)
+	{
+		return false;
+	}
+
+	char *p = slot(head);
+	uint32_t len = length;
+	memcpy(p, &len, sizeof(len));
+	memcpy(p + sizeof(len), payload, length);
+	p[sizeof(len) + length] = 0;
+
+	m_header->head.store(head + 1, memory_order_release);
+
+	return true;
+}
+
+/**
+ * Check whether the rule reported a state change since the last call
+ *
+ * @param    triggered	Set to the current rule state
+ * @return		True if the state changed
+ */
+bool ReadingRingProducer::stateChanged(bool& triggered)
+{
+	if (!isMapped())
+	{
+		return false;
+	}
+	uint64_t sequence = m_header->stateSequence.load(memory_order_acquire);
+	triggered = m_header->state.load(memory_order_relaxed) != 0;
+	if (sequence == m_stateSequence)
+	{
+		return false;
+	}
+	m_stateSequence = sequence;
+	return true;
+}
+
+/**
+ * Consumer constructor
+ *
+ * The ring is attached by open(), the producer might not have
+ * created it yet.
+ *
+ * @param    name	The ring name
+ */
+ReadingRingConsumer::ReadingRingConsumer(const string& name) : ReadingRing(name)
+{
+}
+
+/**
+ * Detach from a segment that is no longer the current one,
+ * so that the next open() attaches to the new producer ring
+ *
+ * @return	True if the ring was detached
+ */
+bool ReadingRingConsumer::detachStale()
+{
+	if (isMapped() && !isCurrent())
+	{
+		detach();
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Return the oldest reading in the ring, without copying it.
+ * The slot is owned by the caller until pop() is called and the
+ * payload can be parsed in place.
+ *
+ * The length is written by the producer process: a slot with
+ * a length that does not fit is released and NULL returned.
+ *
+ * @param    length	Set to the payload length, 0 if the ring is empty
+ * @return		The NUL terminated payload, NULL if the ring
+ *			is empty or the slot has been released
+ */
+char *ReadingRingConsumer::front(size_t& length)
+{
+	length = 0;
+	uint64_t tail = m_header->tail.load(memory_order_relaxed);
+	if (tail == m_header->head.load(memory_order_acquire))
+	{
+		return NULL;
+	}
+
+	char *p = slot(tail);
+	uint32_t len;
+	memcpy(&len, p, sizeof(len));
+	length = len;
+	if (len > m_slotSize - sizeof(len) - 1)
+	{
+		pop();
+		return NULL;
+	}
+
+	// Not trusted to be there
+	p[sizeof(len) + len] = 0;
+
+	return p + sizeof(len);
+}
+
+/**
+ * Release the slot returned by front()
+ */
+void ReadingRingConsumer::pop()
+{
+	m_header->tail.store(m_header->tail.load(memory_order_relaxed) + 1,
+			     memory_order_release);
+}
+
+/**
+ * Report a rule state change to the producer
+ *
+ * @param    triggered	The new rule state
+ */
+void ReadingRingConsumer::reportState(bool triggered)
+{
+	m_header->state.store(triggered ? 1 : 0, memory_order_relaxed);
+	m_header->stateSequence.fetch_add(1, memory_order_release);
+}
@@ -0,0 +1,205 @@
+/**
+ * FogLAMP OutOfBound window spectrum
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <math.h>
+#include <map>
+#include <mutex>
+#include "spectrum.h"
+
+using namespace std;
+
+/**
+ * Build the plan of a real FFT
+ *
+ * @param    size	The transform size, a power of 2 not less than 2
+ */
+FftPlan::FftPlan(size_t size) : m_size(size)
+{
+	size_t half = size / 2;
+
+	int bits = 0;
+	while (((size_t)1 << bits) < half)
+	{
+		bits++;
+	}
+	m_reverse.resize(half);
+	for (size_t i = 0; i < half; i++)
+	{
+		uint32_t r = 0;
+		for (int b = 0; b < bits; b++)
+		{
+			r |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+		m_reverse[i] = r;
+	}
+
+	m_cos.resize(half / 2);
+	m_sin.resize(half / 2);
+	for (size_t j = 0; j < half / 2; j++)
+	{
+		m_cos[j] = cos(2 * M_PI * j / half);
+		m_sin[j] = -sin(2 * M_PI * j / half);
+	}
+
+	m_splitCos.resize(half + 1);
+	m_splitSin.resize(half + 1);
+	for (size_t k = 0; k <= half; k++)
+	{
+		m_splitCos[k] = cos(2 * M_PI * k / size);
+		m_splitSin[k] = -sin(2 * M_PI * k / size);
+	}
+}
+
+/**
+ * Return the shared plan of a transform size
+ *
+ * @param    size	The transform size, a power of 2
+ * @return		The plan, built by the first call
+ */
+shared_ptr<const FftPlan> FftPlan::get(size_t size)
+{
+	static mutex plansMutex;
+	static map<size_t, shared_ptr<const FftPlan>> plans;
+
+	lock_guard<mutex> guard(plansMutex);
+	shared_ptr<const FftPlan>& plan = plans[size];
+	if (!plan)
+	{
+		plan.reset(new FftPlan(size));
+	}
+	return plan;
+}
+
+/**
+ * In place complex FFT of size N/2, radix 2
+ *
+ * @param    re		The real parts
+ * @param    im		The imaginary parts
+ */
+void FftPlan::transform(double *re, double *im) const
+{
+	size_t n = m_size / 2;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t j = m_reverse[i];
+		if (i < j)
+		{
+			double t = re[i];
+			re[i] = re[j];
+			re[j] = t;
+			t = im[i];
+			im[i] = im[j];
+			im[j] = t;
+		}
+	}
+
+	for (size_t length = 2; length <= n; length <<= 1)
+	{
+		size_t half = length / 2;
+		size_t step = n / length;
+		for (size_t i = 0; i < n; i += length)
+		{
+			for (size_t j = 0; j < half; j++)
+			{
+				double wr = m_cos[j * step];
+				double wi = m_sin[j * step];
+				size_t a = i + j;
+				size_t b = a + half;
+				double tr = wr * re[b] - wi * im[b];
+				double ti = wr * im[b] + wi * re[b];
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+/**
+ * Compute the power spectrum of values
+ *
+ * @param    values	The window values
+ * @param    n		The number of values
+ */
+void Spectrum::compute(const double *values, size_t n)
+{
+	if (n > FFT_MAX_SIZE)
+	{
+		n = FFT_MAX_SIZE;
+	}
+	size_t size = 2;
+	while (size < n)
+	{
+		size <<= 1;
+	}
+	if (!m_plan || m_plan->getSize() != size)
+	{
+		m_plan = FftPlan::get(size);
+	}
+	m_size = size;
+
+	// Even values in the real parts, odd values in the imaginary parts
+	size_t half = size / 2;
+	m_re.resize(half);
+	m_im.resize(half);
+	for (size_t m = 0; m < half; m++)
+	{
+		m_re[m] = 2 * m < n ? values[2 * m] : 0;
+		m_im[m] = 2 * m + 1 < n ? values[2 * m + 1] : 0;
+	}
+	m_plan->transform(m_re.data(), m_im.data());
+
+	// Split into the real transform bins, scaled by Parseval
+	m_power.resize(half + 1);
+	double scale = n > 0 ? 1.0 / ((double)n * size) : 0;
+	for (size_t k = 0; k <= half; k++)
+	{
+		size_t p = k < half ? k : 0;
+		size_t q = k > 0 ? half - k : 0;
+		// Transforms of the even and odd values
+		double evenRe = (m_re[p] + m_re[q]) / 2;
+		double evenIm = (m_im[p] - m_im[q]) / 2;
+		double oddRe = (m_im[p] + m_im[q]) / 2;
+		double oddIm = -(m_re[p] - m_re[q]) / 2;
+		double wr = m_plan->getSplitCos(k);
+		double wi = m_plan->getSplitSin(k);
+		double xr = evenRe + wr * oddRe - wi * oddIm;
+		double xi = evenIm + wr * oddIm + wi * oddRe;
+		double weight = k == 0 || k == half ? 1 : 2;
+		m_power[k] = weight * (xr * xr + xi * xi) * scale;
+	}
+}
+
+/**
+ * Return the energy of a frequency band of the last spectrum
+ *
+ * @param    low	The lowest band frequency, included
+ * @param    high	The highest band frequency, excluded
+ * @param    sampleRate	The window sample rate
+ * @return		The sum of the power of the band bins
+ */
+double Spectrum::bandEnergy(double low, double high, double sampleRate) const
+{
+	if (m_size == 0 || sampleRate <= 0)
+	{
+		return 0;
+	}
+	double resolution = sampleRate / m_size;
+	double first = ceil(low / resolution);
+	size_t k = first > 0 ? (size_t)first : 0;
+	double energy = 0;
+	for (; k < m_power.size() && k * resolution < high; k++)
+	{
+		energy += m_power[k];
+	}
+	return energy;
+}
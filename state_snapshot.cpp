@@ -0,0 +1,264 @@
+/**
+ * FogLAMP OutOfBound rule state snapshot
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <libgen.h>
+#include "state_snapshot.h"
+
+using namespace std;
+
+/**
+ * Snapshot constructor
+ */
+StateSnapshot::StateSnapshot() : m_count(0), m_map(NULL), m_mapSize(0)
+{
+}
+
+/**
+ * Snapshot destructor: unmap a loaded snapshot
+ */
+StateSnapshot::~StateSnapshot()
+{
+	if (m_map)
+	{
+		munmap(m_map, m_mapSize);
+	}
+}
+
+/**
+ * Add a record to the snapshot to save
+ *
+ * @param    kind	The record kind
+ * @param    key	The record key
+ * @param    data	The record data
+ * @param    length	The record data length
+ */
+void StateSnapshot::add(uint32_t kind, uint64_t key, const void *data, uint32_t length)
+{
+	StateSnapshotRecord record;
+	record.kind = kind;
+	record.length = length;
+	record.key = key;
+
+	m_records.append((const char *)&record, sizeof(record));
+	m_records.append((const char *)data, length);
+	// Keep next record 8 bytes aligned
+	m_records.append((8 - (length & 7)) & 7, '\0');
+	m_count++;
+}
+
+/**
+ * Write the snapshot to a memory mapped file
+ *
+ * The snapshot is written to a temporary file renamed
+ * to the given path, so a crash leaves the previous snapshot.
+ * The directory is synced so that the rename is durable.
+ *
+ * @param    path	The snapshot file path
+ * @param    program	The hash of the rule configuration
+ * @return		True on success
+ */
+bool StateSnapshot::save(const string& path, uint64_t program) const
+{
+	string tmpPath = path + ".tmp";
+	size_t size = sizeof(StateSnapshotHeader) + m_records.length();
+
+	int fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0640);
+	if (fd < 0)
+	{
+		return false;
+	}
+	if (ftruncate(fd, size) != 0)
+	{
+		close(fd);
+		unlink(tmpPath.c_str());
+		return false;
+	}
+	void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		unlink(tmpPath.c_str());
+		return false;
+	}
+
+	StateSnapshotHeader *header = (StateSnapshotHeader *)addr;
+	memcpy(header->magic, STATE_SNAPSHOT_MAGIC, sizeof(header->magic));
+	header->version = STATE_SNAPSHOT_VERSION;
+	header->count = m_count;
+	header->length = m_records.length();
+	header->checksum = checksum(m_records.data(), m_records.length());
+	header->program = program;
+	memcpy((char *)addr + sizeof(StateSnapshotHeader), m_records.data(), m_records.length());
+
+	bool ret = msync(addr, size, MS_SYNC) == 0;
+	munmap(addr, size);
+
+	if (!ret || rename(tmpPath.c_str(), path.c_str()) != 0)
+	{
+		unlink(tmpPath.c_str());
+		return false;
+	}
+
+	string directory = path;
+	int dirFd = open(dirname(&directory[0]), O_RDONLY | O_DIRECTORY);
+	if (dirFd < 0)
+	{
+		return false;
+	}
+	ret = fsync(dirFd) == 0;
+	close(dirFd);
+
+	return ret;
+}
+
+/**
+ * Map a snapshot file and index its records
+ *
+ * @param    path	The snapshot file path
+ * @param    program	The hash of the rule configuration
+ * @return		False if the file is missing, of a different
+ *			version or rule configuration, or corrupted
+ */
+bool StateSnapshot::load(const string& path, uint64_t program)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 ||
+	    (size_t)st.st_size < sizeof(StateSnapshotHeader))
+	{
+		close(fd);
+		return false;
+	}
+	void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		return false;
+	}
+	m_map = addr;
+	m_mapSize = st.st_size;
+
+	const StateSnapshotHeader *header = (const StateSnapshotHeader *)addr;
+	const char *records = (const char *)addr + sizeof(StateSnapshotHeader);
+	if (memcmp(header->magic, STATE_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != STATE_SNAPSHOT_VERSION ||
+	    header->program != program ||
+	    header->length != m_mapSize - sizeof(StateSnapshotHeader) ||
+	    header->checksum != checksum(records, header->length))
+	{
+		return false;
+	}
+
+	const char *p = records;
+	const char *end = records + header->length;
+	for (uint32_t i = 0; i < header->count; i++)
+	{
+		const StateSnapshotRecord *record = (const StateSnapshotRecord *)p;
+		if (p + sizeof(StateSnapshotRecord) > end ||
+		    p + sizeof(StateSnapshotRecord) + record->length > end)
+		{
+			break;
+		}
+		m_index.insert(make_pair(record->key, record));
+		p += sizeof(StateSnapshotRecord) + ((record->length + 7) & ~7U);
+	}
+
+	return true;
+}
+
+/**
+ * Find a record in a loaded snapshot
+ *
+ * @param    kind	The record kind
+ * @param    key	The record key
+ * @param    length	The expected record data length
+ * @return		The record data or NULL if not found
+ */
+const void *StateSnapshot::find(uint32_t kind, uint64_t key, uint32_t length) const
+{
+	auto range = m_index.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		const StateSnapshotRecord *record = (*it).second;
+		if (record->kind == kind && record->length == length)
+		{
+			return record + 1;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Find a record of variable length in a loaded snapshot
+ *
+ * @param    kind	The record kind
+ * @param    key	The record key
+ * @param    length	Set to the record data length
+ * @return		The record data or NULL if not found
+ */
+const void *StateSnapshot::findRecord(uint32_t kind, uint64_t key, uint32_t& length) const
+{
+	auto range = m_index.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		const StateSnapshotRecord *record = (*it).second;
+		if (record->kind == kind)
+		{
+			length = record->length;
+			return record + 1;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Return the snapshot key of a named object
+ *
+ * @param    name	The object name
+ * @param    parent	The key of the object it belongs to
+ * @return		The 64 bit key
+ */
+uint64_t StateSnapshot::key(const string& name, uint64_t parent)
+{
+	uint64_t h = 0xcbf29ce484222325ULL ^ parent;
+	for (size_t i = 0; i < name.length(); i++)
+	{
+		h = (h ^ (unsigned char)name[i]) * 0x100000001b3ULL;
+	}
+	// Separator: "a" + "bc" differs from "ab" + "c"
+	return (h ^ 0xff) * 0x100000001b3ULL;
+}
+
+/**
+ * Checksum of the snapshot records
+ *
+ * @param    data	The records
+ * @param    length	The records length
+ * @return		The checksum
+ */
+uint64_t StateSnapshot::checksum(const char *data, size_t length)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < length; i++)
+	{
+		h = (h ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+	}
+	return h;
+}
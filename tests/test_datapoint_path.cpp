@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include "datapoint_path.h"
+
+using namespace std;
+
+static const char *reading = "{ \"flow\" : 12.5, \"a/b\" : 1, \"m~n\" : 2, "
+			     "\"motor\" : { \"speed\" : 1450, "
+			     "\"phases\" : [ 10.1, 10.3, 10.2 ], \"0\" : \"zero\" } }";
+
+TEST(DatapointPath, IsPath)
+{
+	ASSERT_TRUE(DatapointPath::isPath("/motor/speed"));
+	ASSERT_FALSE(DatapointPath::isPath("flow"));
+	ASSERT_FALSE(DatapointPath::isPath(""));
+}
+
+TEST(DatapointPath, Member)
+{
+	Document doc;
+	doc.Parse(reading);
+	const Value *v = DatapointPath("flow").find(doc);
+	ASSERT_TRUE(v != NULL);
+	ASSERT_DOUBLE_EQ(v->GetDouble(), 12.5);
+	ASSERT_TRUE(DatapointPath("missing").find(doc) == NULL);
+}
+
+TEST(DatapointPath, Pointer)
+{
+	Document doc;
+	doc.Parse(reading);
+	const Value *v = DatapointPath("/motor/speed").find(doc);
+	ASSERT_TRUE(v != NULL);
+	ASSERT_EQ(v->GetInt(), 1450);
+	v = DatapointPath("/motor/phases/1").find(doc);
+	ASSERT_TRUE(v != NULL);
+	ASSERT_DOUBLE_EQ(v->GetDouble(), 10.3);
+	// An index is a member name in objects
+	v = DatapointPath("/motor/0").find(doc);
+	ASSERT_TRUE(v != NULL);
+	ASSERT_STREQ(v->GetString(), "zero");
+}
+
+TEST(DatapointPath, Escapes)
+{
+	Document doc;
+	doc.Parse(reading);
+	const Value *v = DatapointPath("/a~1b").find(doc);
+	ASSERT_TRUE(v != NULL);
+	ASSERT_EQ(v->GetInt(), 1);
+	v = DatapointPath("/m~0n").find(doc);
+	ASSERT_TRUE(v != NULL);
+	ASSERT_EQ(v->GetInt(), 2);
+}
+
+TEST(DatapointPath, NotFound)
+{
+	Document doc;
+	doc.Parse(reading);
+	ASSERT_TRUE(DatapointPath("/motor/phases/3").find(doc) == NULL);
+	ASSERT_TRUE(DatapointPath("/motor/phases/x").find(doc) == NULL);
+	ASSERT_TRUE(DatapointPath("/motor/phases/-1").find(doc) == NULL);
+	ASSERT_TRUE(DatapointPath("/motor/speed/0").find(doc) == NULL);
+	ASSERT_TRUE(DatapointPath("/pump/speed").find(doc) == NULL);
+}
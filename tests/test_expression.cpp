@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include "expression.h"
+
+using namespace std;
+
+static double eval(const string& source, const vector<double>& operands = vector<double>())
+{
+	Expression expression;
+	EXPECT_TRUE(expression.compile(source)) << source << ": " << expression.getError();
+	return expression.evaluate(operands.data());
+}
+
+TEST(Expression, Precedence)
+{
+	ASSERT_DOUBLE_EQ(eval("1 + 2 * 3"), 7);
+	ASSERT_DOUBLE_EQ(eval("(1 + 2) * 3"), 9);
+	ASSERT_DOUBLE_EQ(eval("8 / 4 / 2"), 1);
+	ASSERT_DOUBLE_EQ(eval("10 - 4 - 3"), 3);
+	ASSERT_DOUBLE_EQ(eval("2 * 3 + 4 * 5"), 26);
+}
+
+TEST(Expression, UnaryMinus)
+{
+	ASSERT_DOUBLE_EQ(eval("-3 + 5"), 2);
+	ASSERT_DOUBLE_EQ(eval("2 * -3"), -6);
+	ASSERT_DOUBLE_EQ(eval("--4"), 4);
+	ASSERT_DOUBLE_EQ(eval("-(1 + 2)"), -3);
+}
+
+TEST(Expression, Functions)
+{
+	ASSERT_DOUBLE_EQ(eval("abs(-2.5)"), 2.5);
+	ASSERT_DOUBLE_EQ(eval("sqrt(16)"), 4);
+	ASSERT_DOUBLE_EQ(eval("min(3, 1 + 1)"), 2);
+	ASSERT_DOUBLE_EQ(eval("max(3, 1 + 1)"), 3);
+	ASSERT_DOUBLE_EQ(eval("max(min(1, 2), abs(-5)) * 2"), 10);
+}
+
+TEST(Expression, Operands)
+{
+	Expression expression;
+	ASSERT_TRUE(expression.compile("flow_in - flow_out + {flow in} / flow_in"));
+	// Each datapoint is loaded once
+	ASSERT_EQ(expression.getOperands().size(), 3u);
+	ASSERT_EQ(expression.getOperands()[0].getName(), "flow_in");
+	ASSERT_EQ(expression.getOperands()[1].getName(), "flow_out");
+	ASSERT_EQ(expression.getOperands()[2].getName(), "flow in");
+	double operands[] = { 10, 4, 5 };
+	ASSERT_DOUBLE_EQ(expression.evaluate(operands), 6.5);
+}
+
+TEST(Expression, Pointers)
+{
+	Expression expression;
+	ASSERT_TRUE(expression.compile("{/motor/phases/0} * 2"));
+	ASSERT_EQ(expression.getOperands().size(), 1u);
+	ASSERT_EQ(expression.getOperands()[0].getName(), "/motor/phases/0");
+	double operands[] = { 1.5 };
+	ASSERT_DOUBLE_EQ(expression.evaluate(operands), 3);
+}
+
+TEST(Expression, NaN)
+{
+	double operands[] = { NAN };
+	ASSERT_TRUE(isnan(eval("a + 1", vector<double>(operands, operands + 1))));
+}
+
+TEST(Expression, Errors)
+{
+	const char *invalid[] = {
+		"", "1 +", "(1 + 2", "foo(1)", "min(1)", "max(1, )",
+		"{}", "{a", "1 2", "a $ b", "sqrt 2", "abs(1"
+	};
+	for (const char *source : invalid)
+	{
+		Expression expression;
+		ASSERT_FALSE(expression.compile(source)) << source;
+		ASSERT_FALSE(expression.getError().empty()) << source;
+	}
+}
+
+TEST(Expression, StackDepth)
+{
+	// Each nesting level keeps one more value on the stack
+	string deep;
+	for (int i = 0; i < EXPRESSION_MAX_STACK; i++)
+	{
+		deep += "1 - (";
+	}
+	deep += "1";
+	deep.append(EXPRESSION_MAX_STACK, ')');
+	Expression expression;
+	ASSERT_FALSE(expression.compile(deep));
+
+	// Left associative chains do not grow the stack
+	string chain = "1";
+	for (int i = 0; i < 4 * EXPRESSION_MAX_STACK; i++)
+	{
+		chain += " + 1";
+	}
+	ASSERT_DOUBLE_EQ(eval(chain), 4 * EXPRESSION_MAX_STACK + 1);
+}
+
+TEST(Expression, Recompile)
+{
+	Expression expression;
+	ASSERT_FALSE(expression.compile("1 +"));
+	ASSERT_TRUE(expression.compile("x * 2"));
+	ASSERT_TRUE(expression.getError().empty());
+	ASSERT_EQ(expression.getOperands().size(), 1u);
+	double operands[] = { 4 };
+	ASSERT_DOUBLE_EQ(expression.evaluate(operands), 8);
+}
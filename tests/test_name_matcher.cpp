@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include <algorithm>
+#include "name_matcher.h"
+
+using namespace std;
+
+static vector<int> match(const NameMatcher& matcher, const char *name)
+{
+	vector<int> matches;
+	vector<int> ids = matcher.match(name, strlen(name), matches);
+	EXPECT_EQ(matcher.matches(name, strlen(name)), !ids.empty());
+	sort(ids.begin(), ids.end());
+	return ids;
+}
+
+TEST(NameMatcher, IsPattern)
+{
+	ASSERT_TRUE(NameMatcher::isPattern("pump_*"));
+	ASSERT_TRUE(NameMatcher::isPattern("temp_?"));
+	ASSERT_TRUE(NameMatcher::isPattern("[ab]"));
+	ASSERT_FALSE(NameMatcher::isPattern("pump_001"));
+}
+
+TEST(NameMatcher, Glob)
+{
+	NameMatcher matcher;
+	ASSERT_TRUE(matcher.add("pump_*", 1));
+	ASSERT_TRUE(matcher.add("*_temp", 2));
+	ASSERT_TRUE(matcher.add("pump_??", 3));
+	ASSERT_TRUE(matcher.add("valve_[0-9][!a]", 4));
+	matcher.compile();
+
+	ASSERT_EQ(match(matcher, "pump_001"), vector<int>({ 1 }));
+	ASSERT_EQ(match(matcher, "pump_01"), vector<int>({ 1, 3 }));
+	ASSERT_EQ(match(matcher, "pump_temp"), vector<int>({ 1, 2 }));
+	ASSERT_EQ(match(matcher, "pump_"), vector<int>({ 1 }));
+	ASSERT_EQ(match(matcher, "tank_temp"), vector<int>({ 2 }));
+	ASSERT_EQ(match(matcher, "valve_1b"), vector<int>({ 4 }));
+	ASSERT_TRUE(match(matcher, "valve_1a").empty());
+	ASSERT_TRUE(match(matcher, "valve_x1").empty());
+	ASSERT_TRUE(match(matcher, "pum").empty());
+	ASSERT_TRUE(match(matcher, "").empty());
+}
+
+TEST(NameMatcher, Backtracking)
+{
+	NameMatcher matcher;
+	ASSERT_TRUE(matcher.add("a*b*c", 1));
+	matcher.compile();
+	ASSERT_EQ(match(matcher, "abc"), vector<int>({ 1 }));
+	ASSERT_EQ(match(matcher, "aXbYbZc"), vector<int>({ 1 }));
+	ASSERT_TRUE(match(matcher, "aXbYbZ").empty());
+	ASSERT_TRUE(match(matcher, "acb").empty());
+}
+
+TEST(NameMatcher, ClosingBracketMember)
+{
+	NameMatcher matcher;
+	ASSERT_TRUE(matcher.add("[]a]x", 1));
+	ASSERT_TRUE(matcher.add("[!]]y", 2));
+	matcher.compile();
+	ASSERT_EQ(match(matcher, "]x"), vector<int>({ 1 }));
+	ASSERT_EQ(match(matcher, "ax"), vector<int>({ 1 }));
+	ASSERT_EQ(match(matcher, "by"), vector<int>({ 2 }));
+	ASSERT_TRUE(match(matcher, "]y").empty());
+}
+
+TEST(NameMatcher, Invalid)
+{
+	NameMatcher matcher;
+	ASSERT_FALSE(matcher.add("pump_[0-9", 1));
+	ASSERT_TRUE(matcher.empty());
+}
+
+TEST(NameMatcher, ManyPatterns)
+{
+	// Same results with the DFA and, past its size limit, one by one
+	NameMatcher matcher;
+	for (int i = 0; i < 200; i++)
+	{
+		char pattern[32];
+		snprintf(pattern, sizeof(pattern), "*%d*_%d?", i, i);
+		ASSERT_TRUE(matcher.add(pattern, i));
+	}
+	matcher.compile();
+	ASSERT_EQ(match(matcher, "x17y_17z"), vector<int>({ 17 }));
+	ASSERT_EQ(match(matcher, "x17y_1z"), vector<int>({ 1 }));
+	ASSERT_EQ(match(matcher, "x17y_17"), vector<int>({ 1 }));
+	ASSERT_TRUE(match(matcher, "x17y_").empty());
+}
+
+TEST(NameMatcher, Regex)
+{
+	ASSERT_TRUE(NameMatcher::isPattern("re:pump_\\d+"));
+	NameMatcher matcher;
+	ASSERT_TRUE(matcher.add("re:pump_\\d{3}", 1));
+	ASSERT_TRUE(matcher.add("re:^(pump|valve)_[a-c]+$", 2));
+	ASSERT_TRUE(matcher.add("re:tank_?\\w*", 3));
+	ASSERT_TRUE(matcher.add("re:x{2,}y{0,2}", 4));
+	ASSERT_TRUE(matcher.add("pump_*", 5));
+	matcher.compile();
+
+	ASSERT_EQ(match(matcher, "pump_001"), vector<int>({ 1, 5 }));
+	ASSERT_EQ(match(matcher, "pump_0001"), vector<int>({ 5 }));
+	ASSERT_EQ(match(matcher, "pump_abc"), vector<int>({ 2, 5 }));
+	ASSERT_EQ(match(matcher, "valve_cab"), vector<int>({ 2 }));
+	ASSERT_TRUE(match(matcher, "valve_").empty());
+	ASSERT_EQ(match(matcher, "tank"), vector<int>({ 3 }));
+	ASSERT_EQ(match(matcher, "tank_1"), vector<int>({ 3 }));
+	ASSERT_TRUE(match(matcher, "tank-1").empty());
+	ASSERT_EQ(match(matcher, "xx"), vector<int>({ 4 }));
+	ASSERT_EQ(match(matcher, "xxxxyy"), vector<int>({ 4 }));
+	ASSERT_TRUE(match(matcher, "xyy").empty());
+	ASSERT_TRUE(match(matcher, "xxyyy").empty());
+}
+
+TEST(NameMatcher, InvalidRegex)
+{
+	NameMatcher matcher;
+	ASSERT_FALSE(matcher.add("re:pump_(\\d", 1));
+	ASSERT_FALSE(matcher.add("re:pump_\\d)", 1));
+	ASSERT_FALSE(matcher.add("re:*pump", 1));
+	ASSERT_FALSE(matcher.add("re:pump{2,1}", 1));
+	ASSERT_FALSE(matcher.add("re:pump{1000}", 1));
+	ASSERT_TRUE(matcher.empty());
+}
+
+TEST(NameMatcher, ManyRegex)
+{
+	// The DFA and the one by one NFA match give the same results
+	NameMatcher matcher;
+	for (int i = 0; i < 200; i++)
+	{
+		char pattern[32];
+		snprintf(pattern, sizeof(pattern), "re:.*%d.*_%d.", i, i);
+		ASSERT_TRUE(matcher.add(pattern, i));
+	}
+	matcher.compile();
+	ASSERT_EQ(match(matcher, "x17y_17z"), vector<int>({ 17 }));
+	ASSERT_EQ(match(matcher, "x17y_1z"), vector<int>({ 1 }));
+	ASSERT_TRUE(match(matcher, "x17y_").empty());
+}
+
+TEST(NameMatcher, NestedFallbackMatches)
+{
+	// Two matchers past the DFA size limit, the first result
+	// still used while the second matcher runs
+	NameMatcher assets;
+	NameMatcher datapoints;
+	for (int i = 0; i < 200; i++)
+	{
+		char pattern[32];
+		snprintf(pattern, sizeof(pattern), "*%d*_%d?", i, i);
+		ASSERT_TRUE(assets.add(pattern, i));
+		snprintf(pattern, sizeof(pattern), "re:.*%d.*-%d.", i, i);
+		ASSERT_TRUE(datapoints.add(pattern, 1000 + i));
+	}
+	assets.compile();
+	datapoints.compile();
+
+	vector<int> assetMatches;
+	vector<int> datapointMatches;
+	const vector<int>& ids = assets.match("x17y_17z", 8, assetMatches);
+	// No DFA: the ids are in the caller buffer
+	ASSERT_EQ(&ids, &assetMatches);
+	ASSERT_EQ(ids, vector<int>({ 17 }));
+	for (int id : ids)
+	{
+		ASSERT_EQ(datapoints.match("a42b-42c", 8, datapointMatches),
+			  vector<int>({ 1042 }));
+		ASSERT_EQ(id, 17);
+	}
+	ASSERT_EQ(ids, vector<int>({ 17 }));
+}
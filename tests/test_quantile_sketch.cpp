@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include "quantile_sketch.h"
+
+// Quantile within the sketch relative accuracy
+#define EXPECT_QUANTILE(actual, expected) \
+	EXPECT_NEAR(actual, expected, fabs(expected) * QUANTILE_SKETCH_ACCURACY + 1e-9)
+
+TEST(QuantileSketch, Keys)
+{
+	for (double v = 0.001; v < 1e6; v *= 1.7)
+	{
+		double bin = QuantileSketch::value(QuantileSketch::key(v));
+		EXPECT_QUANTILE(bin, v);
+	}
+	ASSERT_LT(QuantileSketch::key(1.0), QuantileSketch::key(1.1));
+}
+
+TEST(QuantileWindow, Uniform)
+{
+	QuantileWindow window;
+	window.init(3600);
+	for (int i = 1; i <= 1000; i++)
+	{
+		window.add(i, 1000 + i * 0.1);
+	}
+	double now = 1100;
+	ASSERT_EQ(window.getCount(now), 1000u);
+	EXPECT_QUANTILE(window.quantile(0.99, now), 990);
+	EXPECT_QUANTILE(window.quantile(0.5, now), 500);
+	EXPECT_QUANTILE(window.quantile(0.01, now), 10);
+	EXPECT_QUANTILE(window.quantile(1, now), 1000);
+	EXPECT_QUANTILE(window.quantile(0, now), 1);
+}
+
+TEST(QuantileWindow, Signs)
+{
+	QuantileWindow window;
+	window.init(60);
+	for (int i = -500; i <= 500; i++)
+	{
+		window.add(i, 10);
+	}
+	EXPECT_QUANTILE(window.quantile(0.5, 10), 0);
+	EXPECT_QUANTILE(window.quantile(0.0, 10), -500);
+	EXPECT_QUANTILE(window.quantile(0.25, 10), -250);
+	EXPECT_QUANTILE(window.quantile(0.75, 10), 250);
+}
+
+TEST(QuantileWindow, Slides)
+{
+	QuantileWindow window;
+	window.init(60);
+	for (int i = 0; i < 100; i++)
+	{
+		window.add(1000, i * 0.5);
+	}
+	ASSERT_EQ(window.getCount(50), 100u);
+	// Old values leave the window bucket by bucket
+	for (int i = 0; i < 100; i++)
+	{
+		window.add(1, 200 + i * 0.5);
+	}
+	ASSERT_EQ(window.getCount(250), 100u);
+	EXPECT_QUANTILE(window.quantile(0.99, 250), 1);
+	ASSERT_TRUE(isnan(window.quantile(0.5, 1000)));
+	ASSERT_EQ(window.getCount(1000), 0u);
+}
+
+TEST(QuantileWindow, WideRange)
+{
+	// Magnitudes wider than the store bins merge the smallest ones
+	QuantileWindow window;
+	window.init(60);
+	for (int i = 0; i < 100; i++)
+	{
+		window.add(pow(10, -6 + i * 0.15), 1);
+	}
+	EXPECT_QUANTILE(window.quantile(1, 1), pow(10, -6 + 99 * 0.15));
+	EXPECT_QUANTILE(window.quantile(0.9, 1), pow(10, -6 + 90 * 0.15));
+}
+
+TEST(QuantileWindow, Merge)
+{
+	// Two halves of the values merged give the quantiles of all
+	QuantileWindow low, high, other;
+	low.init(3600);
+	high.init(3600);
+	other.init(60);
+	for (int i = 1; i <= 1000; i++)
+	{
+		(i % 2 ? low : high).add(i, 1000 + i * 0.1);
+	}
+	ASSERT_FALSE(low.merge(other));
+	ASSERT_TRUE(low.merge(high));
+	double now = 1100;
+	ASSERT_EQ(low.getCount(now), 1000u);
+	EXPECT_QUANTILE(low.quantile(0.99, now), 990);
+	EXPECT_QUANTILE(low.quantile(0.5, now), 500);
+	EXPECT_QUANTILE(low.quantile(0, now), 1);
+}
+
+TEST(QuantileWindow, SaveLoad)
+{
+	QuantileWindow window;
+	window.init(600);
+	for (int i = 1; i <= 1000; i++)
+	{
+		window.add(i % 2 ? i : -i, 100 + i * 0.5);
+	}
+	std::string data;
+	window.save(data);
+	// Only the used bins are saved
+	ASSERT_LT(data.length(), sizeof(QuantileWindow) / 4);
+
+	QuantileWindow loaded;
+	ASSERT_TRUE(loaded.load(data.data(), data.length()));
+	double now = 600;
+	ASSERT_EQ(loaded.getCount(now), window.getCount(now));
+	for (double q = 0; q <= 1; q += 0.125)
+	{
+		ASSERT_EQ(loaded.quantile(q, now), window.quantile(q, now));
+	}
+	ASSERT_FALSE(loaded.load(data.data(), data.length() - 1));
+}
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <vector>
+#include "spectrum.h"
+
+using namespace std;
+
+static vector<double> sine(size_t n, double amplitude, double frequency, double sampleRate)
+{
+	vector<double> values(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		values[i] = amplitude * sin(2 * M_PI * frequency * i / sampleRate);
+	}
+	return values;
+}
+
+TEST(Spectrum, Sine)
+{
+	// 125 Hz is bin 8 of a 64 values window at 1000 Hz
+	vector<double> values = sine(64, 2, 125, 1000);
+	Spectrum spectrum;
+	spectrum.compute(values.data(), values.size());
+	EXPECT_NEAR(spectrum.bandEnergy(100, 150, 1000), 2, 1e-9);
+	EXPECT_NEAR(spectrum.bandEnergy(0, 100, 1000), 0, 1e-9);
+	EXPECT_NEAR(spectrum.bandEnergy(150, 500, 1000), 0, 1e-9);
+}
+
+TEST(Spectrum, Parseval)
+{
+	vector<double> values(100);
+	double meanSquare = 0;
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		values[i] = sin(i * 0.37) + 0.5 * cos(i * 1.9) + 0.25;
+		meanSquare += values[i] * values[i];
+	}
+	meanSquare /= values.size();
+	// Zero padded to 128
+	Spectrum spectrum;
+	spectrum.compute(values.data(), values.size());
+	EXPECT_NEAR(spectrum.bandEnergy(0, 1e9, 1000), meanSquare, 1e-9);
+}
+
+TEST(Spectrum, Constant)
+{
+	vector<double> values(32, 3);
+	Spectrum spectrum;
+	spectrum.compute(values.data(), values.size());
+	EXPECT_NEAR(spectrum.bandEnergy(0, 1, 32), 9, 1e-9);
+	EXPECT_NEAR(spectrum.bandEnergy(1, 16, 32), 0, 1e-9);
+}
+
+TEST(Spectrum, Reuse)
+{
+	// Different sizes with the same spectrum object
+	Spectrum spectrum;
+	vector<double> a = sine(256, 1, 250, 1000);
+	spectrum.compute(a.data(), a.size());
+	EXPECT_NEAR(spectrum.bandEnergy(200, 300, 1000), 0.5, 1e-9);
+	vector<double> b = sine(16, 1, 125, 1000);
+	spectrum.compute(b.data(), b.size());
+	EXPECT_NEAR(spectrum.bandEnergy(100, 150, 1000), 0.5, 1e-9);
+	EXPECT_NEAR(spectrum.bandEnergy(200, 300, 1000), 0, 1e-9);
+}
+
+TEST(FftPlan, Shared)
+{
+	ASSERT_EQ(FftPlan::get(64).get(), FftPlan::get(64).get());
+	ASSERT_EQ(FftPlan::get(64)->getSize(), 64u);
+}
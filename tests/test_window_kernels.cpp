@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <vector>
+#include "window_kernels.h"
+
+using namespace std;
+
+TEST(WindowKernels, Sums)
+{
+	double values[] = { 1, -2, 3, 4, 5, 6, 7 };
+	ASSERT_DOUBLE_EQ(sumValues(values, 7), 24);
+	ASSERT_DOUBLE_EQ(sumValues(values, 3), 2);
+	ASSERT_DOUBLE_EQ(sumSquares(values, 7), 140);
+	ASSERT_DOUBLE_EQ(sumSquares(values, 0), 0);
+}
+
+TEST(WindowKernels, SquaredRms)
+{
+	// A constant magnitude of 2: RMS 2, squared 4, below a limit of 3
+	vector<double> squares(10, 4);
+	double rms2 = squaredRms(squares.data(), squares.size());
+	ASSERT_DOUBLE_EQ(rms2, 4);
+	ASSERT_LT(rms2, 3 * 3);
+
+	// Magnitudes 1 and 7: RMS sqrt(25)
+	double magnitudes[] = { 1, 49 };
+	ASSERT_DOUBLE_EQ(squaredRms(magnitudes, 2), 25);
+}
+
+TEST(WindowKernels, AddSquares)
+{
+	// Squared magnitudes of (3, 4) and (1, 1) vectors
+	double sums[] = { 0, 0 };
+	double x[] = { 3, 1 };
+	double y[] = { 4, 1 };
+	addSquares(sums, x, 2);
+	addSquares(sums, y, 2);
+	ASSERT_DOUBLE_EQ(sums[0], 25);
+	ASSERT_DOUBLE_EQ(sums[1], 2);
+}
+
+TEST(WindowKernels, MinMax)
+{
+	double values[] = { 3, -1, 8, 2, 7, -4, 0, 5, 1 };
+	double low, high;
+	minMax(values, 9, low, high);
+	ASSERT_DOUBLE_EQ(low, -4);
+	ASSERT_DOUBLE_EQ(high, 8);
+	minMax(values, 1, low, high);
+	ASSERT_DOUBLE_EQ(low, 3);
+	ASSERT_DOUBLE_EQ(high, 3);
+}
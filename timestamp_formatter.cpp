@@ -0,0 +1,51 @@
+/**
+ * FogLAMP OutOfBound UTC timestamp formatter
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <string.h>
+#include "timestamp_formatter.h"
+
+/**
+ * Format a reading timestamp
+ *
+ * @param    timestamp	Seconds since the epoch
+ * @return		The formatted timestamp, valid until next call
+ */
+const char *TimestampFormatter::format(double timestamp)
+{
+	time_t seconds = (time_t)timestamp;
+
+	if (seconds != m_second)
+	{
+		struct tm tm;
+		gmtime_r(&seconds, &tm);
+		m_prefixLength = strftime(m_buffer,
+					  sizeof(m_buffer),
+					  "%Y-%m-%d %H:%M:%S",
+					  &tm);
+		m_buffer[m_prefixLength] = '.';
+		memcpy(m_buffer + m_prefixLength + 7, "+00:00", 7);
+		m_second = seconds;
+	}
+
+	// Only the microseconds change within the same second
+	long usec = (long)((timestamp - seconds) * 1000000 + 0.5);
+	if (usec > 999999)
+	{
+		usec = 999999;
+	}
+	char *p = m_buffer + m_prefixLength + 6;
+	for (int i = 0; i < 6; i++)
+	{
+		*p-- = '0' + usec % 10;
+		usec /= 10;
+	}
+
+	return m_buffer;
+}
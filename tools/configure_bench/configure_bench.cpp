@@ -0,0 +1,170 @@
+/**
+ * FogLAMP OutOfBound rule configuration benchmark
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <config_category.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include "outofbound.h"
+
+using namespace std;
+using namespace rapidjson;
+
+#define DATAPOINTS_PER_ASSET	10
+
+/**
+ * Build a rule_config of the given number of datapoints,
+ * DATAPOINTS_PER_ASSET per asset
+ *
+ * @param    datapoints	The number of datapoints
+ * @return		The rule_config JSON document
+ */
+static string ruleConfig(unsigned long datapoints)
+{
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+	char name[64];
+
+	writer.StartObject();
+	writer.Key("rules");
+	writer.StartArray();
+	for (unsigned long i = 0; i < datapoints; i += DATAPOINTS_PER_ASSET)
+	{
+		writer.StartObject();
+		writer.Key("asset");
+		writer.StartObject();
+		writer.Key("name");
+		snprintf(name, sizeof(name), "asset_%lu", i / DATAPOINTS_PER_ASSET);
+		writer.String(name);
+		writer.EndObject();
+		writer.Key("evaluation_data");
+		writer.StartObject();
+		writer.Key("value");
+		writer.String("Single Item");
+		writer.EndObject();
+		writer.Key("datapoints");
+		writer.StartArray();
+		for (unsigned long j = i; j < datapoints && j < i + DATAPOINTS_PER_ASSET; j++)
+		{
+			writer.StartObject();
+			writer.Key("name");
+			snprintf(name, sizeof(name), "datapoint_%lu", j - i);
+			writer.String(name);
+			writer.Key("trigger_value");
+			writer.Double(100.0 + j % 50);
+			writer.EndObject();
+		}
+		writer.EndArray();
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+
+	return string(buffer.GetString(), buffer.GetSize());
+}
+
+/**
+ * Build the rule configuration category with a rule_config item
+ *
+ * @param    rules	The rule_config JSON document
+ * @return		The category JSON document
+ */
+static string category(const string& rules)
+{
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+
+	writer.StartObject();
+	writer.Key("rule_config");
+	writer.StartObject();
+	writer.Key("description");
+	writer.String("Rules to evaluate");
+	writer.Key("type");
+	writer.String("JSON");
+	writer.Key("default");
+	writer.String(rules.c_str(), rules.length());
+	writer.Key("value");
+	writer.String(rules.c_str(), rules.length());
+	writer.EndObject();
+	writer.EndObject();
+
+	return string(buffer.GetString(), buffer.GetSize());
+}
+
+/**
+ * Time OutOfBound::configure: the first configuration of a rule
+ * and a reconfiguration with the same rule_config, which keeps
+ * the state of all the asset rules.
+ * The best of the repeated runs is reported.
+ *
+ * Usage: configure_bench [repeat] [datapoints...]
+ *        default 5 runs of 1000, 10000 and 100000 datapoints
+ */
+int main(int argc, char **argv)
+{
+	int repeat = argc > 1 ? atoi(argv[1]) : 5;
+	vector<unsigned long> sizes;
+	for (int i = 2; i < argc; i++)
+	{
+		sizes.push_back(strtoul(argv[i], NULL, 10));
+	}
+	if (sizes.empty())
+	{
+		sizes.push_back(1000);
+		sizes.push_back(10000);
+		sizes.push_back(100000);
+	}
+	if (repeat < 1)
+	{
+		repeat = 1;
+	}
+
+	printf("%12s %8s %14s %14s %12s\n",
+	       "datapoints", "assets", "configure ms", "reconfig ms", "ns/datapoint");
+	for (auto datapoints : sizes)
+	{
+		ConfigCategory config("bench_outofbound", category(ruleConfig(datapoints)));
+		double first = 0;
+		double again = 0;
+		for (int run = 0; run < repeat; run++)
+		{
+			OutOfBound rule;
+
+			auto start = chrono::steady_clock::now();
+			rule.configure(config);
+			auto configured = chrono::steady_clock::now();
+			rule.configure(config);
+			auto reconfigured = chrono::steady_clock::now();
+
+			double ms = chrono::duration<double, milli>(configured - start).count();
+			if (run == 0 || ms < first)
+			{
+				first = ms;
+			}
+			ms = chrono::duration<double, milli>(reconfigured - configured).count();
+			if (run == 0 || ms < again)
+			{
+				again = ms;
+			}
+		}
+		printf("%12lu %8lu %14.2f %14.2f %12.0f\n",
+		       datapoints,
+		       (datapoints + DATAPOINTS_PER_ASSET - 1) / DATAPOINTS_PER_ASSET,
+		       first,
+		       again,
+		       datapoints ? first * 1e6 / datapoints : 0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,85 @@
+/**
+ * FogLAMP OutOfBound shared memory ring stand-in producer
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include "reading_ring.h"
+
+using namespace std;
+
+/**
+ * Feed JSON reading documents, one per line of the standard input,
+ * to an OutOfBound rule configured with the same "ring_buffer" name
+ * and print the rule state changes it reports.
+ *
+ * Usage: ring_producer <ring name> [slots] [slot size] [linger seconds]
+ */
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <ring name> [slots] [slot size] [linger seconds]\n",
+			argv[0]);
+		return 1;
+	}
+	uint32_t slots = argc > 2 ? atoi(argv[2]) : 1024;
+	uint32_t slotSize = argc > 3 ? atoi(argv[3]) : 4096;
+	int linger = argc > 4 ? atoi(argv[4]) : 2;
+
+	ReadingRingProducer ring(argv[1], slots, slotSize);
+	if (!ring.isMapped())
+	{
+		fprintf(stderr, "%s: cannot create ring '%s'\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	unsigned long pushed = 0;
+	bool triggered;
+	string line;
+	while (getline(cin, line))
+	{
+		if (line.empty())
+		{
+			continue;
+		}
+		if (line.length() + sizeof(uint32_t) + 1 > slotSize)
+		{
+			fprintf(stderr, "%s: reading of %lu bytes skipped, slot size %u\n",
+				argv[0], (unsigned long)line.length(), slotSize);
+			continue;
+		}
+		// Wait for the consumer while the ring is full
+		while (!ring.push(line))
+		{
+			this_thread::sleep_for(chrono::microseconds(100));
+		}
+		pushed++;
+		if (ring.stateChanged(triggered))
+		{
+			printf("%lu: %s\n", pushed, triggered ? "triggered" : "cleared");
+		}
+	}
+
+	// Let the consumer evaluate the last readings
+	for (int i = 0; i < linger * 100; i++)
+	{
+		if (ring.stateChanged(triggered))
+		{
+			printf("%lu: %s\n", pushed, triggered ? "triggered" : "cleared");
+		}
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+
+	return 0;
+}